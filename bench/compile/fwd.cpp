@@ -0,0 +1,10 @@
+// A header that only mentions the serializer types
+#include "serde_json/fwd.hpp"
+
+struct Layer;
+
+namespace storage {
+    void save(const Layer &layer, serde_json::ser::Serializer<> &out);
+    void load(Layer &layer, serde_json::de::Deserializer &in);
+    const serde_json::error::Error *last_error();
+}
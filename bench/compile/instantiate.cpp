@@ -0,0 +1,6 @@
+// The one file that instantiates the JSON code for types.hpp
+#include "types.hpp"
+
+SERDE_JSON_INSTANTIATE(Point)
+SERDE_JSON_INSTANTIATE(Label)
+SERDE_JSON_INSTANTIATE(Layer)
@@ -0,0 +1,38 @@
+#ifndef COMPILE_BENCH_TYPES_H_
+#define COMPILE_BENCH_TYPES_H_
+
+#include <vector>
+
+#include <ftl.hpp>
+
+#include "serde/macros.hpp"
+#include "serde_json/json.hpp"
+
+struct Point {
+    long x;
+    long y;
+};
+DERIVE((Point, x, y), SERIALIZE, DESERIALIZE)
+
+struct Label {
+    ftl::str text;
+    Point at;
+    int size;
+};
+DERIVE((Label, text, at, size), SERIALIZE, DESERIALIZE)
+
+struct Layer {
+    ftl::str name;
+    std::vector<Point> points;
+    std::vector<Label> labels;
+    int zorder;
+};
+DERIVE((Layer, name, points, labels, zorder), SERIALIZE, DESERIALIZE)
+
+#ifdef USE_EXTERN
+SERDE_JSON_EXTERN(Point)
+SERDE_JSON_EXTERN(Label)
+SERDE_JSON_EXTERN(Layer)
+#endif
+
+#endif // !COMPILE_BENCH_TYPES_H_
@@ -0,0 +1,12 @@
+// A file that encodes and decodes the types from types.hpp
+#include "types.hpp"
+
+serde_json::error::Result<size_t> roundtrip(const char *layer_json, const char *label_json) {
+    Layer layer = TRY(serde_json::from_str<Layer>(layer_json));
+    Label label = TRY(serde_json::from_str<Label>(label_json));
+    size_t n = TRY(serde_json::to_string(layer)).size();
+    n += TRY(serde_json::to_string_pretty(layer)).size();
+    n += TRY(serde_json::to_string(label)).size();
+    n += TRY(serde_json::to_string(label.at)).size();
+    return ftl::Ok(n);
+}
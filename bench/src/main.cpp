@@ -0,0 +1,576 @@
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <new>
+#include <string>
+#include <variant>
+#include <unordered_map>
+#include <vector>
+
+#include <ftl.hpp>
+
+#include "serde/intern.hpp"
+#include "serde/macros.hpp"
+#include "serde/transcode.hpp"
+#include "serde_json/engine.hpp"
+#include "serde_json/file.hpp"
+#include "serde_json/json.hpp"
+
+/******************************************************************************/
+// Counting allocator
+
+static std::atomic<size_t> allocations{0};
+
+void *operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *ptr = malloc(size ? size : 1)) return ptr;
+    throw std::bad_alloc();
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete[](void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { free(ptr); }
+
+/******************************************************************************/
+// Harness
+
+template<typename T>
+inline void do_not_optimize(const T &value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/**
+ * @brief Runs f until at least MIN_TIME has passed and prints one result row
+ * @param bytes size of the JSON document f produces or consumes, 0 to skip MB/s
+ */
+template<typename F>
+void bench(const char *name, size_t bytes, F f) {
+    using clock = std::chrono::steady_clock;
+    constexpr auto MIN_TIME = std::chrono::milliseconds(500);
+
+    for (int i = 0; i < 3; i++) f(); // warm up
+
+    size_t iters = 0;
+    size_t allocs_before = allocations.load(std::memory_order_relaxed);
+    auto start = clock::now();
+    auto elapsed = clock::duration::zero();
+    do {
+        for (size_t i = 0; i < 16; i++) f();
+        iters += 16;
+        elapsed = clock::now() - start;
+    } while (elapsed < MIN_TIME);
+    size_t allocs = allocations.load(std::memory_order_relaxed) - allocs_before;
+
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count() / iters;
+    printf("%-32s %10zu %14.1f", name, bytes, ns);
+    if (bytes) printf(" %10.1f", bytes / ns * 1e9 / (1 << 20));
+    else       printf(" %10s", "-");
+    printf(" %12.2f\n", (double)allocs / iters);
+}
+
+template<typename T>
+void bench_roundtrip(const char *name, const T &value) {
+    std::string json = serde_json::to_string(value).unwrap();
+    std::string ser_name = std::string("ser/") + name;
+    std::string de_name = std::string("de/") + name;
+    std::string validate_name = std::string("validate/") + name;
+
+    bench(ser_name.c_str(), json.size(), [&] {
+        auto res = serde_json::to_string(value);
+        do_not_optimize(res);
+    });
+    bench(de_name.c_str(), json.size(), [&] {
+        auto res = serde_json::from_str<T>(json.c_str());
+        do_not_optimize(res);
+    });
+    bench(validate_name.c_str(), json.size(), [&] {
+        auto res = serde_json::validate<T>(json.c_str());
+        do_not_optimize(res);
+    });
+}
+
+// Reads json and writes it back without a schema, to compare with a roundtrip
+void bench_transcode(const char *name, const std::string &json) {
+    std::string transcode_name = std::string("transcode/") + name;
+    bench(transcode_name.c_str(), json.size(), [&] {
+        serde_json::de::Deserializer deserializer(json.c_str());
+        serde_json::ser::Serializer<> serializer;
+        auto res = serde::transcode(deserializer, serializer);
+        do_not_optimize(res);
+        do_not_optimize(serializer.output);
+    });
+}
+
+template<typename T>
+void bench_ser(const char *name, const T &value) {
+    std::string json = serde_json::to_string(value).unwrap();
+    std::string ser_name = std::string("ser/") + name;
+    bench(ser_name.c_str(), json.size(), [&] {
+        auto res = serde_json::to_string(value);
+        do_not_optimize(res);
+    });
+}
+
+// Serializes into a buffer sized once up front, nothing is allocated per run
+template<typename T>
+void bench_span(const char *name, const T &value) {
+    std::string json = serde_json::to_string(value).unwrap();
+    std::vector<char> buf(json.size());
+    std::string span_name = std::string("span/") + name;
+    bench(span_name.c_str(), json.size(), [&] {
+        auto res = serde_json::to_span(value, buf);
+        do_not_optimize(res);
+    });
+}
+
+// Canonical form as a string, and hashed without building one
+template<typename T>
+void bench_canonical(const char *name, const T &value) {
+    std::string json = serde_json::to_string_canonical(value).unwrap();
+    std::string canonical_name = std::string("canonical/") + name;
+    std::string hash_name = std::string("hash/") + name;
+    bench(canonical_name.c_str(), json.size(), [&] {
+        auto res = serde_json::to_string_canonical(value);
+        do_not_optimize(res);
+    });
+    bench(hash_name.c_str(), json.size(), [&] {
+        auto res = serde_json::hash_canonical(value);
+        do_not_optimize(res);
+    });
+}
+
+// Deterministic xorshift so every run benchmarks the same documents
+struct Rng {
+    uint64_t state = 0x9E3779B97F4A7C15;
+    uint64_t next() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+    long range(long lo, long hi) { return lo + next() % (hi - lo); }
+};
+
+/******************************************************************************/
+// Documents
+
+struct RGB {
+    int r;
+    int g;
+    int b;
+};
+DERIVE((RGB, r, g, b), SERIALIZE, DESERIALIZE)
+
+struct ColoredText {
+    RGB color;
+    ftl::str text;
+};
+DERIVE((ColoredText, color, text), SERIALIZE, DESERIALIZE)
+
+// canada.json-like: long runs of coordinate pairs in nested arrays.
+// Coordinates are fixed-point (1e-7 degrees) for the decode side.
+struct Geometry {
+    ftl::str type;
+    std::vector<std::vector<std::array<long, 2>>> coordinates;
+};
+DERIVE((Geometry, type, coordinates), SERIALIZE, DESERIALIZE)
+
+struct Feature {
+    ftl::str type;
+    Geometry geometry;
+};
+DERIVE((Feature, type, geometry), SERIALIZE, DESERIALIZE)
+
+// twitter.json-like: records dominated by short strings and small structs
+struct User {
+    long long id;
+    ftl::str screen_name;
+    ftl::str name;
+    ftl::str location;
+    int followers_count;
+};
+DERIVE((User, id, screen_name, name, location, followers_count), SERIALIZE, DESERIALIZE)
+
+struct Status {
+    long long id;
+    ftl::str created_at;
+    ftl::str text;
+    User user;
+    int retweet_count;
+    int favorite_count;
+    std::vector<ftl::str> hashtags;
+};
+DERIVE((Status, id, created_at, text, user, retweet_count, favorite_count, hashtags),
+       SERIALIZE, DESERIALIZE)
+
+// Event stream: internally tagged messages
+struct Move {
+    int x;
+    int y;
+};
+DERIVE((Move, x, y), SERIALIZE, DESERIALIZE)
+
+struct Chat {
+    long long user;
+    ftl::str text;
+};
+DERIVE((Chat, user, text), SERIALIZE, DESERIALIZE)
+
+using Event = std::variant<RGB, Move, Chat>;
+
+// Rows whose strings repeat, decoded into owned strings or interned
+struct OwnedRow {
+    long long id;
+    std::string region;
+    std::string status;
+};
+DERIVE((OwnedRow, id, region, status), SERIALIZE, DESERIALIZE)
+
+struct InternedRow {
+    long long id;
+    serde::Interned region;
+    serde::Interned status;
+};
+DERIVE((InternedRow, id, region, status), SERIALIZE, DESERIALIZE)
+
+// Sparse records, most optional fields absent. Nulls writes every None as
+// null, Skipped leaves them out and accepts them missing.
+#define SPARSE_FIELDS                                                   \
+    long long id;                                                       \
+    ftl::Option<ftl::str> name;                                         \
+    ftl::Option<ftl::str> email;                                        \
+    ftl::Option<ftl::str> phone;                                        \
+    ftl::Option<ftl::str> country;                                      \
+    ftl::Option<ftl::str> city;                                         \
+    ftl::Option<int> age;                                               \
+    ftl::Option<int> score;                                             \
+    ftl::Option<int> rank;                                              \
+    ftl::Option<int> level;                                             \
+    ftl::Option<long long> referrer;                                    \
+    ftl::Option<long long> last_seen;
+
+struct SparseNulls { SPARSE_FIELDS };
+DERIVE((SparseNulls, id, name, email, phone, country, city, age, score, rank, level,
+        referrer, last_seen), SERIALIZE, DESERIALIZE)
+
+struct SparseSkipped { SPARSE_FIELDS };
+DERIVE((SparseSkipped, id, (name, skip_if_none, default), (email, skip_if_none, default),
+        (phone, skip_if_none, default), (country, skip_if_none, default),
+        (city, skip_if_none, default), (age, skip_if_none, default),
+        (score, skip_if_none, default), (rank, skip_if_none, default),
+        (level, skip_if_none, default), (referrer, skip_if_none, default),
+        (last_seen, skip_if_none, default)), SERIALIZE, DESERIALIZE)
+#undef SPARSE_FIELDS
+
+template<>
+struct serde::VariantRepr<Event> {
+    static constexpr TagStyle style = TagStyle::Internal;
+    static constexpr ftl::str tag = "type";
+    static constexpr ftl::str content = "content";
+};
+
+static const char *const WORDS[] = {
+    "lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing",
+    "elit", "sed", "do", "eiusmod", "tempor", "incididunt", "ut", "labore",
+};
+
+// Strings are borrowed by ftl::str, so the corpora keep their storage here
+static std::deque<std::string> arena;
+
+static ftl::str sentence(Rng &rng, size_t words) {
+    std::string out;
+    for (size_t i = 0; i < words; i++) {
+        if (i) out += ' ';
+        out += WORDS[rng.next() % std::size(WORDS)];
+    }
+    arena.push_back(std::move(out));
+    return ftl::str(arena.back().data(), arena.back().size());
+}
+
+static Feature make_canada(Rng &rng) {
+    Feature feature{"Feature", {"Polygon", {}}};
+    for (int ring = 0; ring < 40; ring++) {
+        std::vector<std::array<long, 2>> points;
+        for (int i = 0; i < 1000; i++) {
+            points.push_back({rng.range(-1410000000, -520000000),
+                              rng.range(420000000, 830000000)});
+        }
+        feature.geometry.coordinates.push_back(std::move(points));
+    }
+    return feature;
+}
+
+static std::vector<Status> make_twitter(Rng &rng) {
+    std::vector<Status> statuses;
+    for (int i = 0; i < 500; i++) {
+        Status status{
+            .id = (long long)rng.next() >> 2,
+            .created_at = "Sun Aug 31 00:29:15 +0000 2014",
+            .text = sentence(rng, rng.range(5, 25)),
+            .user = {
+                .id = (long long)rng.next() >> 2,
+                .screen_name = sentence(rng, 1),
+                .name = sentence(rng, 2),
+                .location = sentence(rng, rng.range(0, 3)),
+                .followers_count = (int)rng.range(0, 100000),
+            },
+            .retweet_count = (int)rng.range(0, 1000),
+            .favorite_count = (int)rng.range(0, 1000),
+            .hashtags = {},
+        };
+        for (long n = rng.range(0, 4); n > 0; n--) {
+            status.hashtags.push_back(sentence(rng, 1));
+        }
+        statuses.push_back(std::move(status));
+    }
+    return statuses;
+}
+
+static std::vector<Event> make_events(Rng &rng) {
+    std::vector<Event> events;
+    for (int i = 0; i < 10000; i++) {
+        switch (rng.next() % 3) {
+        case 0:
+            events.push_back(RGB{(int)rng.range(0, 256), (int)rng.range(0, 256), (int)rng.range(0, 256)});
+            break;
+        case 1:
+            events.push_back(Move{(int)rng.range(-1000, 1000), (int)rng.range(-1000, 1000)});
+            break;
+        default:
+            events.push_back(Chat{(long long)rng.next() >> 2, sentence(rng, rng.range(1, 12))});
+        }
+    }
+    return events;
+}
+
+// distinct is how many values region and status are drawn from, 0 for all unique
+static std::string make_rows(Rng &rng, size_t distinct) {
+    static const char *const STATUSES[] = {
+        "pending-verification", "active-subscription", "suspended-for-review",
+        "cancelled-by-customer", "payment-method-expired", "archived-after-inactivity",
+    };
+    std::vector<OwnedRow> rows;
+    for (long long i = 0; i < 10000; i++) {
+        size_t pick = distinct ? rng.next() % distinct : i;
+        rows.push_back({i, "region-" + std::to_string(pick) + "-availability-zone",
+                        distinct ? STATUSES[pick % std::size(STATUSES)]
+                                 : "status-" + std::to_string(rng.next())});
+    }
+    return serde_json::to_string(rows).unwrap();
+}
+
+// String bytes a decoded corpus keeps on the heap, beside the rows themselves
+static size_t owned_bytes(const std::vector<OwnedRow> &rows) {
+    size_t res = 0;
+    for (const OwnedRow &row : rows) {
+        for (const std::string *str : {&row.region, &row.status}) {
+            if (str->capacity() > std::string().capacity()) res += str->capacity() + 1;
+        }
+    }
+    return res;
+}
+
+static void report_bytes(const char *name, size_t bytes) {
+    printf("%-32s %10zu %14s %10s %12s\n", name, bytes, "-", "-", "-");
+}
+
+static void bench_intern(const char *name, const std::string &json) {
+    std::string owned_name = std::string("de/") + name + "_owned";
+    std::string interned_name = std::string("de/") + name + "_interned";
+    bench(owned_name.c_str(), json.size(), [&] {
+        auto res = serde_json::from_str<std::vector<OwnedRow>>(json.c_str());
+        do_not_optimize(res);
+    });
+    bench(interned_name.c_str(), json.size(), [&] {
+        auto res = serde_json::from_str<std::vector<InternedRow>>(json.c_str());
+        do_not_optimize(res);
+    });
+
+    // The global pool is shared by both corpora, a fresh one shows what one holds
+    std::vector<OwnedRow> rows = serde_json::from_str<std::vector<OwnedRow>>(json.c_str()).unwrap();
+    serde::InternPool pool;
+    for (const OwnedRow &row : rows) {
+        pool.intern(ftl::str(row.region.data(), row.region.size()));
+        pool.intern(ftl::str(row.status.data(), row.status.size()));
+    }
+    std::string owned_mem = std::string("mem/") + name + "_owned";
+    std::string interned_mem = std::string("mem/") + name + "_interned";
+    report_bytes(owned_mem.c_str(), owned_bytes(rows));
+    report_bytes(interned_mem.c_str(), pool.bytes());
+}
+
+// Each record has its id and on average one of the optional fields
+template<typename T>
+static std::vector<T> make_sparse(Rng &rng) {
+    std::vector<T> records(10000);
+    for (size_t i = 0; i < records.size(); i++) {
+        T &rec = records[i];
+        rec.id = (long long)i;
+        switch (rng.next() % 12) {
+        case 0: rec.name = ftl::Some(sentence(rng, 2)); break;
+        case 1: rec.city = ftl::Some(sentence(rng, 1)); break;
+        case 2: rec.age = ftl::Some((int)rng.range(18, 90)); break;
+        case 3: rec.score = ftl::Some((int)rng.range(0, 1000)); break;
+        case 4: rec.last_seen = ftl::Some((long long)rng.next() >> 24); break;
+        default: break;
+        }
+    }
+    return records;
+}
+
+// Moves the leading `"type":"..."` of every event to the end of its object,
+// which makes the decoder take the rescan path. Events hold no nested objects.
+static std::string tags_last(const std::string &json) {
+    std::string out;
+    size_t pos = 0;
+    for (size_t obj; (obj = json.find("{\"type\":\"", pos)) != std::string::npos; ) {
+        size_t comma = json.find(',', obj);
+        size_t close = json.find('}', comma);
+        out.append(json, pos, obj + 1 - pos);
+        out.append(json, comma + 1, close - comma - 1);
+        out += ',';
+        out.append(json, obj + 1, comma - obj - 1);
+        out += '}';
+        pos = close + 1;
+    }
+    out.append(json, pos);
+    return out;
+}
+
+/******************************************************************************/
+
+int main() {
+    Rng rng;
+
+    printf("%-32s %10s %14s %10s %12s\n",
+           "benchmark", "bytes", "ns/op", "MB/s", "allocs/op");
+
+    // micro
+    RGB color{0xFF, 0x00, 0xAC};
+    bench_roundtrip("rgb", color);
+    {
+        serde_json::ser::Buffer<RGB> buf;
+        bench("span/rgb_stack", serde_json::to_string(color).unwrap().size(), [&] {
+            auto res = serde_json::to_span(color, buf);
+            do_not_optimize(res);
+        });
+    }
+    bench_roundtrip("colored_text", ColoredText{color, "bar"});
+
+    std::vector<int> ints;
+    for (int i = 0; i < 100000; i++) ints.push_back((int)rng.range(-1000000, 1000000));
+    bench_roundtrip("int_array", ints);
+    {
+        std::string json = serde_json::to_string(ints).unwrap();
+        std::vector<int> reused;
+        bench("de/int_array_extend", json.size(), [&] {
+            reused.clear();
+            auto res = serde_json::from_str_seed(serde::de::Extend<std::vector<int>>{&reused}, json.c_str());
+            do_not_optimize(res);
+        });
+    }
+
+    std::vector<double> floats;
+    for (int i = 0; i < 100000; i++) floats.push_back(rng.range(-1000000, 1000000) / 997.0);
+    bench_ser("float_array", floats);
+    bench_span("float_array", floats);
+
+    std::vector<ftl::str> strings;
+    for (int i = 0; i < 20000; i++) strings.push_back(sentence(rng, rng.range(1, 12)));
+    bench_roundtrip("string_array", strings);
+
+    std::vector<ColoredText> texts;
+    for (int i = 0; i < 10000; i++) {
+        texts.push_back({{(int)rng.range(0, 256), (int)rng.range(0, 256), (int)rng.range(0, 256)},
+                         sentence(rng, rng.range(1, 8))});
+    }
+    bench_roundtrip("nested_structs", texts);
+
+    // macro
+    Feature canada = make_canada(rng);
+    bench_roundtrip("canada", canada);
+    bench_transcode("canada", serde_json::to_string(canada).unwrap());
+    std::vector<Status> twitter = make_twitter(rng);
+    bench_roundtrip("twitter", twitter);
+    bench_span("twitter", twitter);
+    bench_canonical("twitter", twitter);
+    {
+        // Hash iteration order, the canonical form has to sort it
+        std::unordered_map<std::string, int> counters;
+        for (int i = 0; i < 10000; i++) counters[std::to_string(rng.next())] = (int)rng.range(0, 1000);
+        bench_ser("string_map", counters);
+        bench_canonical("string_map", counters);
+        // Reserved from the entry count, keys found without building a std::string
+        using Transparent = std::unordered_map<std::string, int, serde::de::StringHash, std::equal_to<>>;
+        std::string json = serde_json::to_string(counters).unwrap();
+        bench("de/string_map", json.size(), [&] {
+            auto res = serde_json::from_str<std::unordered_map<std::string, int>>(json.c_str());
+            do_not_optimize(res);
+        });
+        bench("de/string_map_transparent", json.size(), [&] {
+            auto res = serde_json::from_str<Transparent>(json.c_str());
+            do_not_optimize(res);
+        });
+    }
+    bench_transcode("twitter", serde_json::to_string(twitter).unwrap());
+    {
+        // Steady state of a worker thread: buffers reused from the previous call
+        const serde_json::Engine<> engine;
+        std::string json = serde_json::to_string(twitter).unwrap();
+        bench("engine/ser/twitter", json.size(), [&] {
+            auto res = engine.write(twitter);
+            do_not_optimize(res);
+        });
+        bench("engine/de/twitter", json.size(), [&] {
+            auto res = engine.from_str<std::vector<Status>>(json.c_str());
+            do_not_optimize(res);
+        });
+    }
+
+    // Whole-file decode: read() into a string versus mapping the file
+    std::string twitter_json = serde_json::to_string(twitter).unwrap();
+    char path[] = "/tmp/serde_bench_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd >= 0 && write(fd, twitter_json.data(), twitter_json.size()) == (ssize_t)twitter_json.size()) {
+        bench("de/twitter_read_file", twitter_json.size(), [&] {
+            std::string buf;
+            FILE *file = fopen(path, "rb");
+            buf.resize(twitter_json.size());
+            buf.resize(fread(buf.data(), 1, buf.size(), file));
+            fclose(file);
+            auto res = serde_json::from_str<std::vector<Status>>(buf.c_str());
+            do_not_optimize(res);
+        });
+        bench("de/twitter_from_file", twitter_json.size(), [&] {
+            auto res = serde_json::from_file<std::vector<Status>>(path);
+            do_not_optimize(res);
+        });
+    }
+    if (fd >= 0) {
+        close(fd);
+        unlink(path);
+    }
+
+    Rng sparse_rng = rng;
+    bench_roundtrip("sparse_nulls", make_sparse<SparseNulls>(sparse_rng));
+    bench_roundtrip("sparse_skipped", make_sparse<SparseSkipped>(rng));
+
+    bench_intern("rows_low_card", make_rows(rng, 24));
+    bench_intern("rows_high_card", make_rows(rng, 0));
+
+    std::vector<Event> events = make_events(rng);
+    bench_roundtrip("events", events);
+    std::string events_last = tags_last(serde_json::to_string(events).unwrap());
+    bench("de/events_tag_last", events_last.size(), [&] {
+        auto res = serde_json::from_str<std::vector<Event>>(events_last.c_str());
+        do_not_optimize(res);
+    });
+
+    return 0;
+}
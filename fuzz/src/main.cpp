@@ -0,0 +1,317 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <ftl.hpp>
+
+#include "fst/datatype_macros.hpp"
+#include "serde/macros.hpp"
+#include "serde/transcode.hpp"
+#include "serde_json/framer.hpp"
+#include "serde_json/json.hpp"
+
+/**
+ * Differential fuzz target for serde_json::de::Deserializer.
+ *
+ * Every input is decoded through each entry point that should agree with
+ * from_str: from_slice on an unterminated copy, validate, DocumentFramer fed
+ * in two chunks, transcode followed by from_str. Accepted values have to
+ * survive a to_string/from_str round trip, and the vectorized UTF-8
+ * validator has to agree with the scalar one. Any disagreement aborts.
+ *
+ * Built with -DSERDE_FUZZ_LIBFUZZER this is a libFuzzer target. Otherwise
+ * it is a standalone driver: given files or directories it replays them
+ * and reports the time spent on each, without arguments it runs a
+ * deterministic mutation loop and a nesting depth probe, so performance
+ * cliffs show up as a growing ns/byte.
+ */
+
+/******************************************************************************/
+// Types under test
+
+struct RGB {
+    int r;
+    int g;
+    int b;
+};
+DERIVE((RGB, r, g, b), SERIALIZE, DESERIALIZE)
+
+struct ColoredText {
+    RGB color;
+    ftl::str text;
+};
+DERIVE((ColoredText, color, text), SERIALIZE, DESERIALIZE)
+
+/******************************************************************************/
+// Checks
+
+// Decoded value in canonical form, so results of any entry point compare
+struct Outcome {
+    bool ok = false;
+    std::string json;
+
+    bool operator==(const Outcome &) const = default;
+};
+
+template<typename T>
+static Outcome outcome(serde_json::error::Result<T> res) {
+    Outcome out;
+    match(std::move(res)) {{
+        of(Ok, (value)) {
+            out.ok = true;
+            out.json = serde_json::to_string(value).unwrap();
+        }
+        of(Err) {}
+    }}
+    return out;
+}
+
+template<typename T>
+static bool succeeded(serde_json::error::Result<T> res) {
+    match(std::move(res)) {{
+        of(Ok) { return true; }
+        of(Err) {}
+    }}
+    return false;
+}
+
+[[noreturn]] static void mismatch(const char *what, const char *type, const std::string &input) {
+    fprintf(stderr, "%s (%s)\ninput (%zu bytes): %s\n", what, type, input.size(), input.c_str());
+    abort();
+}
+
+// Schemaless pass, reaches every nesting level whatever T expects
+static Outcome transcoded(const std::string &input) {
+    serde_json::de::Deserializer deserializer(input.c_str());
+    serde_json::ser::Serializer<> serializer;
+    Outcome out;
+    out.ok = succeeded(serde::transcode(deserializer, serializer))
+          && deserializer.input == deserializer.end;
+    if (out.ok) out.json = std::move(serializer.output);
+    return out;
+}
+
+template<typename T>
+static void check(const char *type, const uint8_t *data, size_t size) {
+    // Exactly size bytes on the heap, so reading past the end is caught
+    std::unique_ptr<char[]> exact(new char[size]);
+    if (size) memcpy(exact.get(), data, size);
+    Outcome slice = outcome(serde_json::from_slice<T>(exact.get(), size));
+
+    // from_str stops at the first NUL, it can only be compared without one
+    if (memchr(data, '\0', size) != nullptr) return;
+    std::string input(reinterpret_cast<const char *>(data), size);
+
+    Outcome str = outcome(serde_json::from_str<T>(input.c_str()));
+    if (!(slice == str)) mismatch("from_slice differs from from_str", type, input);
+
+    if (succeeded(serde_json::validate<T>(input.c_str())) != str.ok) {
+        mismatch("validate differs from from_str", type, input);
+    }
+
+    serde_json::DocumentFramer<T> body;
+    size_t split = size ? data[0] % (size + 1) : 0;
+    bool fed = succeeded(body.feed(input.data(), split))
+            && succeeded(body.feed(input.data() + split, size - split));
+    // A complete document followed by more than whitespace is a pipelined body there
+    bool pipelined = body.ready()
+            && body.buffer.find_first_not_of(" \t\n\r", body.complete) != std::string::npos;
+    // DocumentFramer drops the whitespace around a document, from_str takes none
+    size_t first = std::min(input.find_first_not_of(" \t\n\r"), size);
+    size_t last = input.find_last_not_of(" \t\n\r") + 1;
+    Outcome framed = first == 0 && last == size ? str
+            : outcome(serde_json::from_str<T>(input.substr(first, last - first).c_str()));
+    if (fed && !pipelined) {
+        if (!(outcome(body.take()) == framed)) mismatch("DocumentFramer differs from from_str", type, input);
+    } else if (framed.ok) {
+        mismatch("DocumentFramer rejects a document from_str accepts", type, input);
+    }
+
+    if (!str.ok) return;
+    if (!(outcome(serde_json::from_str<T>(str.json.c_str())) == str)) {
+        mismatch("to_string output does not decode to the same value", type, input);
+    }
+    Outcome any = transcoded(input);
+    if (!any.ok) mismatch("transcode rejects a document from_str accepts", type, input);
+    if (!(outcome(serde_json::from_str<T>(any.json.c_str())) == str)) {
+        mismatch("transcoded document decodes to another value", type, input);
+    }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    // The SIMD validator has to agree with the scalar one on any bytes
+    const char *bytes = reinterpret_cast<const char *>(data);
+    bool scalar = serde_json::utf8::first_invalid_scalar(bytes, size) == size;
+    if (serde_json::utf8::valid(bytes, size) != scalar) {
+        mismatch("utf8::valid differs from the scalar check", "bytes", std::string(bytes, size));
+    }
+    check<RGB>("RGB", data, size);
+    check<ColoredText>("ColoredText", data, size);
+    check<std::vector<ColoredText>>("std::vector<ColoredText>", data, size);
+    check<std::vector<int>>("std::vector<int>", data, size);
+
+    // Transcoding its own output must not change it
+    if (memchr(data, '\0', size) == nullptr) {
+        std::string input(reinterpret_cast<const char *>(data), size);
+        Outcome once = transcoded(input);
+        if (once.ok && !(transcoded(once.json) == once)) {
+            mismatch("transcode is not idempotent", "any", input);
+        }
+    }
+    return 0;
+}
+
+#ifndef SERDE_FUZZ_LIBFUZZER
+/******************************************************************************/
+// Standalone driver
+
+using Clock = std::chrono::steady_clock;
+
+struct Timing {
+    std::string name;
+    size_t bytes;
+    double ns;
+};
+
+// Runs one input until at least a millisecond has passed, ns per run
+static double time_input(const std::string &input) {
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(input.data());
+    size_t runs = 0;
+    auto start = Clock::now();
+    auto elapsed = Clock::duration::zero();
+    do {
+        LLVMFuzzerTestOneInput(data, input.size());
+        runs++;
+        elapsed = Clock::now() - start;
+    } while (elapsed < std::chrono::milliseconds(1));
+    return std::chrono::duration<double, std::nano>(elapsed).count() / runs;
+}
+
+static void print_timing(const Timing &t) {
+    printf("%12.0f ns %10.1f ns/B %8zu B  %s\n",
+           t.ns, t.ns / std::max<size_t>(t.bytes, 1), t.bytes, t.name.c_str());
+}
+
+static void print_slowest(std::vector<Timing> &timings) {
+    std::sort(timings.begin(), timings.end(), [](const Timing &a, const Timing &b) {
+        return a.ns / std::max<size_t>(a.bytes, 1) > b.ns / std::max<size_t>(b.bytes, 1);
+    });
+    printf("slowest per byte:\n");
+    for (size_t i = 0; i < std::min<size_t>(timings.size(), 5); i++) print_timing(timings[i]);
+}
+
+static int replay(int argc, char **argv) {
+    std::vector<std::filesystem::path> paths;
+    for (int i = 1; i < argc; i++) {
+        if (std::filesystem::is_directory(argv[i])) {
+            for (auto &entry : std::filesystem::recursive_directory_iterator(argv[i])) {
+                if (entry.is_regular_file()) paths.push_back(entry.path());
+            }
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+
+    std::vector<Timing> timings;
+    for (const auto &path : paths) {
+        std::ifstream file(path, std::ios::binary);
+        std::string input((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        timings.push_back({path.string(), input.size(), time_input(input)});
+        print_timing(timings.back());
+    }
+    print_slowest(timings);
+    return 0;
+}
+
+// Deterministic xorshift, the same seed always explores the same inputs
+struct Rng {
+    uint64_t state = 0x9E3779B97F4A7C15;
+    uint64_t next() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+    size_t below(size_t n) { return n ? next() % n : 0; }
+};
+
+static const char *const SEEDS[] = {
+    R"({"r":1,"g":2,"b":3})",
+    R"({"color":{"r":5,"g":25,"b":30},"text":"baz"})",
+    R"([{"color":{"r":0,"g":0,"b":0},"text":""},{"color":{"r":-1,"g":2,"b":3},"text":"a b"}])",
+    R"([1,-2,30,400])",
+    R"({"b":3,"g":2,"r":1})",
+    R"([[],{},null,true,false,"s",1.5e3])",
+    "[\"caf\xc3\xa9\",\"\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e text long enough for a block\",\"\xf0\x9f\x98\x80\"]",
+};
+// Bytes the parser cares about, inserted more often than random ones
+static const char TOKENS[] = "{}[]\":,-0123456789.eEtfnrulsa\\ ";
+
+static std::string mutate(Rng &rng, std::string input) {
+    size_t edits = 1 + rng.below(4);
+    for (size_t i = 0; i < edits; i++) {
+        size_t pos = rng.below(input.size() + 1);
+        char ch = rng.below(4) ? TOKENS[rng.below(sizeof(TOKENS) - 1)] : (char)rng.next();
+        switch (rng.below(4)) {
+        case 0:
+            input.insert(input.begin() + pos, ch);
+            break;
+        case 1:
+            if (pos < input.size()) input[pos] = ch;
+            break;
+        case 2:
+            if (pos < input.size()) input.erase(pos, 1 + rng.below(3));
+            break;
+        case 3:
+            input.resize(pos);
+            break;
+        }
+    }
+    return input;
+}
+
+static int explore(size_t iterations) {
+    Rng rng;
+    std::vector<Timing> timings;
+    auto start = Clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        std::string input = mutate(rng, SEEDS[rng.below(std::size(SEEDS))]);
+        auto before = Clock::now();
+        LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t *>(input.data()), input.size());
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - before).count();
+        timings.push_back({input, input.size(), ns});
+    }
+    double total = std::chrono::duration<double>(Clock::now() - start).count();
+    printf("%zu inputs in %.2fs, %.0f inputs/s\n", iterations, total, iterations / total);
+    print_slowest(timings);
+
+    // Time per byte has to stay flat as nesting grows
+    printf("nesting depth probe:\n");
+    for (size_t depth = 16; depth <= 1024; depth *= 4) {
+        std::string nested = std::string(depth, '[') + std::string(depth, ']');
+        print_timing({"[...] depth " + std::to_string(depth), nested.size(), time_input(nested)});
+        nested = "";
+        for (size_t d = 0; d < depth; d++) nested += R"({"a":)";
+        nested += "1" + std::string(depth, '}');
+        print_timing({"{...} depth " + std::to_string(depth), nested.size(), time_input(nested)});
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) return replay(argc, argv);
+    const char *iterations = getenv("SERDE_FUZZ_ITERATIONS");
+    return explore(iterations ? strtoull(iterations, nullptr, 10) : 100000);
+}
+#endif
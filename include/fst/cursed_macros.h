@@ -4,6 +4,18 @@
 #define CAR(x, ...) x
 #define CDR(_, ...) __VA_ARGS__
 
+// IS_PAREN((a, b)) is 1, IS_PAREN(a) is 0
+#define _IS_PAREN_PROBE(...) ~, 1
+#define _IS_PAREN_CHECK_N(x, n, ...) n
+#define _IS_PAREN_CHECK(...) _IS_PAREN_CHECK_N(__VA_ARGS__, 0, )
+#define IS_PAREN(x) _IS_PAREN_CHECK(_IS_PAREN_PROBE x)
+
+// IF(1)(then, else) is then, IF(0)(then, else) is else
+#define _IF_1(t, f) t
+#define _IF_0(t, f) f
+#define _IF_(c) _IF_##c
+#define IF(c) _IF_(c)
+
 // clang-format off
 #define _NUM_ARGS2(X,X64,X63,X62,X61,X60,X59,X58,X57,X56,X55,X54,X53,X52,X51,X50,X49,X48,X47,X46,X45,X44,X43,X42,X41,X40,X39,X38,X37,X36,X35,X34,X33,X32,X31,X30,X29,X28,X27,X26,X25,X24,X23,X22,X21,X20,X19,X18,X17,X16,X15,X14,X13,X12,X11,X10,X9,X8,X7,X6,X5,X4,X3,X2,X1,N,...) N
 #define NUM_ARGS(...) _NUM_ARGS2(0, __VA_ARGS__ ,64,63,62,61,60,59,58,57,56,55,54,53,52,51,50,49,48,47,46,45,44,43,42,41,40,39,38,37,36,35,34,33,32,31,30,29,28,27,26,25,24,23,22,21,20,19,18,17,16,15,14,13,12,11,10,9,8,7,6,5,4,3,2,1,0)
@@ -4,12 +4,21 @@
 #include <ftl.hpp>
 
 #include <array>
+#include <charconv>
 #include <concepts>
 #include <cstddef>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <utility>
+#include <variant>
+#include <vector>
 
 #include "fst/fst.hpp"
 #include "fst/datatype_macros.hpp"
+#include "serde/flat_map.hpp"
+#include "serde/variant.hpp"
 
 namespace serde {
 namespace de {
@@ -44,36 +53,49 @@ namespace de {
             ftl::str Str_val;
             ftl::str Other_val;
         };
-        friend std::ostream &operator<<(std::ostream &out, const Unexpected &unexp) {
-            match(unexp) {{
+        std::string description() const {
+            std::string res;
+            match(*this) {{
                 of(Bool, (b)) {
-                    return out << "boolean `" << b << '`';
+                    res += "boolean `";
+                    res += b ? "true" : "false";
                 }
                 of(Unsigned, (i)) {
-                    return out << "integer `" << i << '`';
+                    res += "integer `" + std::to_string(i);
                 }
                 of(Signed, (i)) {
-                    return out << "integer `" << i << '`';
+                    res += "integer `" + std::to_string(i);
                 }
                 of(Float, (f)) {
-                    return out << "floating point `" << f << '`';
+                    char buf[32];
+                    res += "floating point `";
+                    res.append(buf, std::to_chars(buf, buf + sizeof(buf), f).ptr);
                 }
                 of(Char, (c)) {
-                    return out << "character `" << c << '`';
+                    res += "character `";
+                    res += c;
                 }
                 of(Str, (s)) {
-                    return out << "string " << s;
+                    res += "string ";
+                    res += s;
+                    return res;
                 }
                 of(Unit) {
-                    return out << "unit value";
+                    return "unit value";
                 }
                 of(Map) {
-                    return out << "map";
+                    return "map";
                 }
                 of(Other, (other)) {
-                    return out << other;
+                    res += other;
+                    return res;
                 }
             }}
+            res += '`';
+            return res;
+        }
+        friend std::ostream &operator<<(std::ostream &out, const Unexpected &unexp) {
+            return out << unexp.description();
         }
     };
 
@@ -81,16 +103,17 @@ namespace de {
         template<typename Self>
         concept Error = fst::error::Error<Self>
                      && requires(Self err,
-                                 const char *msg,
                                  Unexpected unexp,
                                  const size_t len,
                                  const ftl::str field,
                                  const ftl::Slice<const ftl::str> &expected) {
-            { Self::custom(msg) } -> std::same_as<Self>;
+            // Messages are string literals, an error may keep just the pointer
+            { Self::custom("") } -> std::same_as<Self>;
             { Self::invalid_type(unexp) } -> std::same_as<Self>;
             { Self::invalid_value(unexp) } -> std::same_as<Self>;
             { Self::invalid_length(len) } -> std::same_as<Self>;
             { Self::unknown_field(field, expected) } -> std::convertible_to<Self>;
+            { Self::unknown_variant(field, expected) } -> std::convertible_to<Self>;
             { Self::missing_field(field) } -> std::same_as<Self>;
             { Self::duplicate_field(field) } -> std::same_as<Self>;
         };
@@ -111,6 +134,7 @@ namespace detail::archetypes::de {
         static Error invalid_value(serde::de::Unexpected);
         static Error invalid_length(size_t);
         static Error unknown_field(const ftl::str, const ftl::Slice<ftl::str>);
+        static Error unknown_variant(const ftl::str, const ftl::Slice<ftl::str>);
         static Error missing_field(const ftl::str);
         static Error duplicate_field(const ftl::str);
     };
@@ -125,15 +149,26 @@ namespace detail::archetypes::de {
     struct Visitor {
         using Value = T;
 
+        ftl::Result<Value, Error> visit_unit();
+
+        ftl::Result<Value, Error> visit_none();
+
         ftl::Result<Value, Error> visit_bool(bool);
 
         ftl::Result<Value, Error> visit_char(char);
 
+        ftl::Result<Value, Error> visit_schar(signed char);
         ftl::Result<Value, Error> visit_short(short);
         ftl::Result<Value, Error> visit_int(int);
         ftl::Result<Value, Error> visit_long(long);
         ftl::Result<Value, Error> visit_long_long(long long);
 
+        ftl::Result<Value, Error> visit_uchar(unsigned char);
+        ftl::Result<Value, Error> visit_ushort(unsigned short);
+        ftl::Result<Value, Error> visit_uint(unsigned int);
+        ftl::Result<Value, Error> visit_ulong(unsigned long);
+        ftl::Result<Value, Error> visit_ulong_long(unsigned long long);
+
         ftl::Result<Value, Error> visit_float(float);
         ftl::Result<Value, Error> visit_double(double);
 
@@ -155,10 +190,16 @@ namespace de::concepts {
     requires(V visitor,
              bool Bool,
              char Char,
+             signed char SChar,
              short Short,
              int Int,
              long Long,
              long long LongLong,
+             unsigned char UChar,
+             unsigned short UShort,
+             unsigned int UInt,
+             unsigned long ULong,
+             unsigned long long ULongLong,
              float Float,
              double Double,
              ftl::str Str,
@@ -169,6 +210,8 @@ namespace de::concepts {
         std::same_as<ftl::Result<typename V::Value, E>>;
         { visitor.visit_char(Char) } ->
         std::same_as<ftl::Result<typename V::Value, E>>;
+        { visitor.visit_schar(SChar) } ->
+        std::same_as<ftl::Result<typename V::Value, E>>;
         { visitor.visit_short(Short) } ->
         std::same_as<ftl::Result<typename V::Value, E>>;
         { visitor.visit_int(Int) } ->
@@ -177,6 +220,16 @@ namespace de::concepts {
         std::same_as<ftl::Result<typename V::Value, E>>;
         { visitor.visit_long_long(LongLong) } ->
         std::same_as<ftl::Result<typename V::Value, E>>;
+        { visitor.visit_uchar(UChar) } ->
+        std::same_as<ftl::Result<typename V::Value, E>>;
+        { visitor.visit_ushort(UShort) } ->
+        std::same_as<ftl::Result<typename V::Value, E>>;
+        { visitor.visit_uint(UInt) } ->
+        std::same_as<ftl::Result<typename V::Value, E>>;
+        { visitor.visit_ulong(ULong) } ->
+        std::same_as<ftl::Result<typename V::Value, E>>;
+        { visitor.visit_ulong_long(ULongLong) } ->
+        std::same_as<ftl::Result<typename V::Value, E>>;
         { visitor.visit_float(Float) } ->
         std::same_as<ftl::Result<typename V::Value, E>>;
         { visitor.visit_double(Double) } ->
@@ -197,9 +250,17 @@ namespace de::concepts {
         { deserializer.deserialize_any(visitor) } -> std::same_as<
         ftl::Result<typename decltype(visitor)::Value, typename D::Error>>;
 
+        { deserializer.deserialize_option(visitor) } -> std::same_as<
+        ftl::Result<typename decltype(visitor)::Value, typename D::Error>>;
+
         { deserializer.deserialize_bool(visitor) } -> std::same_as<
         ftl::Result<typename decltype(visitor)::Value, typename D::Error>>;
 
+        { deserializer.deserialize_char(visitor) } -> std::same_as<
+        ftl::Result<typename decltype(visitor)::Value, typename D::Error>>;
+
+        { deserializer.deserialize_schar(visitor) } -> std::same_as<
+        ftl::Result<typename decltype(visitor)::Value, typename D::Error>>;
         { deserializer.deserialize_short(visitor) } -> std::same_as<
         ftl::Result<typename decltype(visitor)::Value, typename D::Error>>;
         { deserializer.deserialize_int(visitor) } -> std::same_as<
@@ -209,6 +270,8 @@ namespace de::concepts {
         { deserializer.deserialize_long_long(visitor) } -> std::same_as<
         ftl::Result<typename decltype(visitor)::Value, typename D::Error>>;
 
+        { deserializer.deserialize_uchar(visitor) } -> std::same_as<
+        ftl::Result<typename decltype(visitor)::Value, typename D::Error>>;
         { deserializer.deserialize_ushort(visitor) } -> std::same_as<
         ftl::Result<typename decltype(visitor)::Value, typename D::Error>>;
         { deserializer.deserialize_uint(visitor) } -> std::same_as<
@@ -218,6 +281,11 @@ namespace de::concepts {
         { deserializer.deserialize_ulong_long(visitor) } -> std::same_as<
         ftl::Result<typename decltype(visitor)::Value, typename D::Error>>;
 
+        { deserializer.deserialize_float(visitor) } -> std::same_as<
+        ftl::Result<typename decltype(visitor)::Value, typename D::Error>>;
+        { deserializer.deserialize_double(visitor) } -> std::same_as<
+        ftl::Result<typename decltype(visitor)::Value, typename D::Error>>;
+
         { deserializer.deserialize_str(visitor) } -> std::same_as<
         ftl::Result<typename decltype(visitor)::Value, typename D::Error>>;
         { deserializer.deserialize_identifier(visitor) } -> std::same_as<
@@ -229,6 +297,8 @@ namespace de::concepts {
         ftl::Result<typename decltype(visitor)::Value, typename D::Error>>;
         { deserializer.deserialize_struct(name, fields, visitor) } -> std::same_as<
         ftl::Result<typename decltype(visitor)::Value, typename D::Error>>;
+        { deserializer.deserialize_enum(name, fields, visitor) } -> std::same_as<
+        ftl::Result<typename decltype(visitor)::Value, typename D::Error>>;
     };
 }
 
@@ -250,80 +320,151 @@ namespace de {
         }
     };
 
-    template<>
-    struct Deserialize<short> {
-        template<concepts::Deserializer D>
-        static ftl::Result<short, typename D::Error>
-        deserialize(D &deserializer) {
-            struct ShortVisitor {
-                using Value = short;
-                ftl::Result<Value, typename D::Error>
-                visit_short(int value) {
-                    return ftl::Ok(value);
-                }
-            };
-            return deserializer.deserialize_short(ShortVisitor{});
+    // Value of the seeds that write into storage they point to
+    struct Appended {};
+
+    /**
+     * @brief   Seed deserializing one element onto the end of *dest
+     * @details The element goes from the deserializer straight into
+     *          push_back, instead of into an Option that next_element<T>()
+     *          returns and the visitor moves it out of. Being a pointer, the
+     *          seed costs nothing to pass for every element.
+     */
+    template<typename C>
+    struct AppendTo {
+        C *dest;
+    };
+    template<typename C>
+    struct DeserializeSeed<AppendTo<C>> {
+        using Value = Appended;
+
+        template<typename D>
+        static ftl::Result<Appended, typename D::Error>
+        deserialize(const AppendTo<C> &self, D &deserializer) {
+            self.dest->push_back(
+                    TRY(Deserialize<typename C::value_type>::deserialize(deserializer)));
+            return ftl::Ok(Appended{});
         }
     };
-    template<>
-    struct Deserialize<int> {
-        template<concepts::Deserializer D>
-        static ftl::Result<int, typename D::Error>
-        deserialize(D &deserializer) {
-            struct IntVisitor {
-                using Value = int;
-                ftl::Result<Value, typename D::Error>
-                visit_int(int value) {
-                    return ftl::Ok(value);
-                }
-            };
-            return deserializer.deserialize_int(IntVisitor{});
+
+    /**
+     * @brief   Seed appending a whole sequence to *dest, keeping what it holds
+     * @details Lets the caller decode into storage that already exists, a
+     *          vector reused across documents keeps its capacity. The value
+     *          is the number of elements appended. On error the elements
+     *          read before it stay appended.
+     */
+    template<typename C>
+    struct Extend {
+        C *dest;
+    };
+    template<typename C>
+    struct DeserializeSeed<Extend<C>> {
+        using Value = size_t;
+
+        template<typename D>
+        static ftl::Result<size_t, typename D::Error>
+        deserialize(const Extend<C> &self, D &deserializer) {
+            return deserializer.deserialize_seq(Visitor{self.dest});
         }
+        struct Visitor {
+            using Value = size_t;
+            C *dest;
+            template<typename A> // SeqAccess
+            ftl::Result<Value, typename A::Error>
+            visit_seq(A seq) {
+                size_t count = 0;
+                while (TRY(seq.next_element_seed(AppendTo<C>{dest})).is_some()) count++;
+                return ftl::Ok(count);
+            }
+        };
+    };
+
+    // Each type asks for its own width, so the deserializer parses straight
+    // into it and checks the range it allows instead of reading a long long
+    // and narrowing. int8_t to uint64_t are typedefs of these.
+#define __DESERIALIZE_PRIMITIVE(T, NAME)                                    \
+    template<>                                                              \
+    struct Deserialize<T> {                                                 \
+        template<concepts::Deserializer D>                                  \
+        static ftl::Result<T, typename D::Error>                            \
+        deserialize(D &deserializer) {                                      \
+            struct PrimitiveVisitor {                                       \
+                using Value = T;                                            \
+                ftl::Result<Value, typename D::Error>                       \
+                visit_##NAME(T value) {                                     \
+                    return ftl::Ok(value);                                  \
+                }                                                           \
+            };                                                              \
+            return deserializer.deserialize_##NAME(PrimitiveVisitor{});     \
+        }                                                                   \
     };
+    __DESERIALIZE_PRIMITIVE(bool, bool)
+    __DESERIALIZE_PRIMITIVE(char, char)
+    __DESERIALIZE_PRIMITIVE(signed char, schar)
+    __DESERIALIZE_PRIMITIVE(short, short)
+    __DESERIALIZE_PRIMITIVE(int, int)
+    __DESERIALIZE_PRIMITIVE(long, long)
+    __DESERIALIZE_PRIMITIVE(long long, long_long)
+    __DESERIALIZE_PRIMITIVE(unsigned char, uchar)
+    __DESERIALIZE_PRIMITIVE(unsigned short, ushort)
+    __DESERIALIZE_PRIMITIVE(unsigned int, uint)
+    __DESERIALIZE_PRIMITIVE(unsigned long, ulong)
+    __DESERIALIZE_PRIMITIVE(unsigned long long, ulong_long)
+    __DESERIALIZE_PRIMITIVE(float, float)
+    __DESERIALIZE_PRIMITIVE(double, double)
+#undef __DESERIALIZE_PRIMITIVE
+
     template<>
-    struct Deserialize<long> {
+    struct Deserialize<ftl::str> {
         template<concepts::Deserializer D>
-        static ftl::Result<long, typename D::Error>
+        static ftl::Result<ftl::str, typename D::Error>
         deserialize(D &deserializer) {
-            struct LongVisitor {
-                using Value = long;
+            struct StrVisitor {
+                using Value = ftl::str;
                 ftl::Result<Value, typename D::Error>
-                visit_long(long value) {
+                visit_str(ftl::str value) {
                     return ftl::Ok(value);
                 }
             };
-            return deserializer.deserialize_long(LongVisitor{});
+            return deserializer.deserialize_str(StrVisitor{});
         }
     };
     template<>
-    struct Deserialize<long long> {
+    struct Deserialize<std::string> {
         template<concepts::Deserializer D>
-        static ftl::Result<long long, typename D::Error>
+        static ftl::Result<std::string, typename D::Error>
         deserialize(D &deserializer) {
-            struct LongLongVisitor {
-                using Value = long long;
+            struct StringVisitor {
+                using Value = std::string;
                 ftl::Result<Value, typename D::Error>
-                visit_long_long(long long value) {
-                    return ftl::Ok(value);
+                visit_str(ftl::str value) {
+                    std::string res;
+                    res += value;
+                    return ftl::Ok(std::move(res));
                 }
             };
-            return deserializer.deserialize_long_long(LongLongVisitor{});
+            return deserializer.deserialize_str(StringVisitor{});
         }
     };
 
-    template<>
-    struct Deserialize<ftl::str> {
+    template<typename T>
+    struct Deserialize<ftl::Option<T>> {
         template<concepts::Deserializer D>
-        static ftl::Result<ftl::str, typename D::Error>
+        static ftl::Result<ftl::Option<T>, typename D::Error>
         deserialize(D &deserializer) {
-            struct StrVisitor {
-                using Value = ftl::str;
+            struct OptionVisitor {
+                using Value = ftl::Option<T>;
                 ftl::Result<Value, typename D::Error>
-                visit_str(ftl::str value) {
-                    return ftl::Ok(value);
+                visit_none() {
+                    return ftl::Ok(ftl::Option<T>(ftl::None()));
+                }
+                ftl::Result<Value, typename D::Error>
+                visit_some(D &deserializer) {
+                    return ftl::Ok(ftl::Some(TRY(Deserialize<T>::deserialize(deserializer))));
                 }
             };
-            return deserializer.deserialize_str(StrVisitor{});
+            return deserializer.deserialize_option(OptionVisitor{});
         }
     };
 
@@ -342,13 +483,325 @@ namespace de {
                 std::array<T, N> arr;
                 for (size_t i = 0; i < N; i++) {
                     ftl::Option<T> elem = TRY(seq.template next_element<T>());
-                    if (elem.is_none()) return ftl::Err(A::Error::invalid_length(i - 1));
+                    if (elem.is_none()) return ftl::Err(A::Error::invalid_length(i));
                     arr[i] = elem.unwrap();
                 }
+                // Formats without an end marker would otherwise drop the rest
+                ftl::Option<T> extra = TRY(seq.template next_element<T>());
+                if (extra.is_some()) return ftl::Err(A::Error::invalid_length(N + 1));
                 return ftl::Ok(std::move_if_noexcept(arr));
             }
         };
     };
+    template<typename T>
+    struct Deserialize<std::vector<T>> {
+        template<concepts::Deserializer D>
+        static ftl::Result<std::vector<T>, typename D::Error>
+        deserialize(D &deserializer) {
+            return deserializer.deserialize_seq(VecVisitor{});
+        }
+        struct VecVisitor {
+            using Value = std::vector<T>;
+            template<typename A> // SeqAccess
+            ftl::Result<Value, typename A::Error>
+            visit_seq(A seq) {
+                std::vector<T> vec;
+                while (TRY(seq.next_element_seed(AppendTo<std::vector<T>>{&vec})).is_some()) {}
+                return ftl::Ok(std::move(vec));
+            }
+        };
+    };
+
+    // Number of entries the MapAccess expects, if the format knows it up front
+    template<typename A>
+    ftl::Option<size_t> size_hint(const A &access) {
+        if constexpr (requires { access.size_hint(); }) {
+            return access.size_hint();
+        } else {
+            return ftl::Option<size_t>(ftl::None());
+        }
+    }
+
+    /**
+     * @brief   Transparent hash for maps keyed by std::string
+     * @details std::unordered_map<std::string, V, StringHash, std::equal_to<>>
+     *          can be searched with a std::string_view, like a std::map with
+     *          std::less<>. Deserializing into either looks keys up borrowed
+     *          and only builds a std::string for a key it has not seen.
+     */
+    struct StringHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view key) const {
+            return std::hash<std::string_view>{}(key);
+        }
+    };
+
+    inline std::string_view key_view(const ftl::str &key) {
+        return key.len() ? std::string_view(&*key.begin(), key.len()) : std::string_view();
+    }
+    // M finds its std::string keys by a std::string_view, without building one
+    template<typename M>
+    concept BorrowedLookup = std::same_as<typename M::key_type, std::string>
+        && requires(M &map, std::string_view key) { map.find(key); };
+
+    /**
+     * @brief   Visitor shared by the map containers
+     * @details Reserves when the container can and the format gives a size
+     *          hint, then adds entries through Insert, so a repeated key
+     *          keeps its last value like a JSON object. Maps with a
+     *          BorrowedLookup take their keys as ftl::str and hand them to
+     *          Insert that way.
+     */
+    template<typename M, typename K, typename V, typename Insert>
+    struct MapVisitor {
+        using Value = M;
+        using Key = std::conditional_t<BorrowedLookup<M>, ftl::str, K>;
+        template<typename A> // MapAccess
+        ftl::Result<Value, typename A::Error>
+        visit_map(A map) {
+            M res;
+            if constexpr (requires { res.reserve(size_t()); }) {
+                ftl::Option<size_t> hint = size_hint(map);
+                if (hint.is_some()) res.reserve(hint.unwrap());
+            }
+            for (auto key = TRY(map.template next_key<Key>());
+                    key.is_some();
+                    key = TRY(map.template next_key<Key>())) {
+                V value = TRY(map.template next_value<V>());
+                Insert{}(res, key.unwrap(), std::move(value));
+            }
+            if constexpr (requires { res.sort_unique(); }) res.sort_unique();
+            return ftl::Ok(std::move(res));
+        }
+    };
+    struct InsertOrAssign {
+        template<typename M, typename K, typename V>
+        void operator()(M &map, K key, V value) {
+            map.insert_or_assign(std::move(key), std::move(value));
+        }
+        // Borrowed key, the std::string is only built for a new entry
+        template<typename M, typename V> requires BorrowedLookup<M>
+        void operator()(M &map, ftl::str key, V value) {
+            std::string_view view = key_view(key);
+            auto it = map.find(view);
+            if (it != map.end()) {
+                it->second = std::move(value);
+            } else {
+                map.emplace(std::string(view), std::move(value));
+            }
+        }
+    };
+    // FlatMap appends and sorts once at the end instead of shifting per key
+    struct PushBack {
+        template<typename M, typename K, typename V>
+        void operator()(M &map, K key, V value) {
+            map.push_back(std::move(key), std::move(value));
+        }
+        template<typename M, typename V> requires BorrowedLookup<M>
+        void operator()(M &map, ftl::str key, V value) {
+            map.push_back(std::string(key_view(key)), std::move(value));
+        }
+    };
+
+    template<typename K, typename V, typename C, typename A>
+    struct Deserialize<std::map<K, V, C, A>> {
+        template<concepts::Deserializer D>
+        static ftl::Result<std::map<K, V, C, A>, typename D::Error>
+        deserialize(D &deserializer) {
+            return deserializer.deserialize_map(Visitor{});
+        }
+        using Visitor = MapVisitor<std::map<K, V, C, A>, K, V, InsertOrAssign>;
+    };
+    template<typename K, typename V, typename H, typename E, typename A>
+    struct Deserialize<std::unordered_map<K, V, H, E, A>> {
+        template<concepts::Deserializer D>
+        static ftl::Result<std::unordered_map<K, V, H, E, A>, typename D::Error>
+        deserialize(D &deserializer) {
+            return deserializer.deserialize_map(Visitor{});
+        }
+        using Visitor = MapVisitor<std::unordered_map<K, V, H, E, A>, K, V, InsertOrAssign>;
+    };
+    template<typename K, typename V, typename C>
+    struct Deserialize<FlatMap<K, V, C>> {
+        template<concepts::Deserializer D>
+        static ftl::Result<FlatMap<K, V, C>, typename D::Error>
+        deserialize(D &deserializer) {
+            return deserializer.deserialize_map(Visitor{});
+        }
+        using Visitor = MapVisitor<FlatMap<K, V, C>, K, V, PushBack>;
+    };
+
+    // Seeds for the variant tag (the alternative's index) and its content
+    template<typename V>
+    struct VariantTag {};
+    template<typename V>
+    struct VariantContent {
+        size_t index;
+    };
+
+    /**
+     * @brief   std::variant, tagged as VariantRepr says
+     * @details The tag is looked up in NAMES and the index picks the
+     *          alternative's deserialize function out of a constexpr table,
+     *          so no alternative is tried and rolled back. External and
+     *          adjacent tagging only need MapAccess. Internal tagging needs
+     *          the format to find the tag inside the alternative's own
+     *          object, through deserialize_internally_tagged.
+     */
+    template<typename... Ts>
+    struct Deserialize<std::variant<Ts...>> {
+        using Value = std::variant<Ts...>;
+        using Repr = VariantRepr<Value>;
+
+        constexpr static ftl::str NAMES[] = {
+            detail::variant_name<Ts, Deserialize<Ts>>()...
+        };
+        constexpr static ftl::str ADJACENT_FIELDS[] = { Repr::tag, Repr::content };
+
+        // sizeof...(Ts) when there is no such alternative
+        static size_t index_of(const ftl::str &name) {
+            for (size_t i = 0; i < sizeof...(Ts); i++) {
+                if (detail::name_eq(NAMES[i], name)) return i;
+            }
+            return sizeof...(Ts);
+        }
+
+        template<typename T, typename D>
+        static ftl::Result<Value, typename D::Error> alternative(D &deserializer) {
+            T value = TRY(Deserialize<T>::deserialize(deserializer));
+            return ftl::Ok(Value(std::in_place_type<T>, std::move(value)));
+        }
+        template<typename D>
+        using Alternative = ftl::Result<Value, typename D::Error> (*)(D &);
+        template<typename D>
+        constexpr static Alternative<D> TABLE[] = { &alternative<Ts, D>... };
+
+        // Decodes the rest of an object whose tag has already been read
+        template<typename T, typename A>
+        static ftl::Result<Value, typename A::Error> alternative_entries(A map) {
+            if constexpr (requires { typename Deserialize<T>::Visitor; }) {
+                T value = TRY(typename Deserialize<T>::Visitor{}.visit_map(map));
+                return ftl::Ok(Value(std::in_place_type<T>, std::move(value)));
+            } else {
+                return ftl::Err(A::Error::invalid_type(Unexpected::Map()));
+            }
+        }
+        template<typename A>
+        using AlternativeEntries = ftl::Result<Value, typename A::Error> (*)(A);
+        template<typename A>
+        constexpr static AlternativeEntries<A> ENTRIES_TABLE[] = { &alternative_entries<Ts, A>... };
+
+        template<concepts::Deserializer D>
+        static ftl::Result<Value, typename D::Error>
+        deserialize(D &deserializer) {
+            if constexpr (Repr::style == TagStyle::External) {
+                return deserializer.deserialize_enum("variant", NAMES, ExternalVisitor{});
+            } else if constexpr (Repr::style == TagStyle::Adjacent) {
+                return deserializer.deserialize_struct("variant", ADJACENT_FIELDS, AdjacentVisitor{});
+            } else {
+                static_assert(requires { deserializer.deserialize_internally_tagged(Repr::tag, InternalVisitor{}); },
+                        "this format can not decode internally tagged variants");
+                return deserializer.deserialize_internally_tagged(Repr::tag, InternalVisitor{});
+            }
+        }
+
+        // {"Name": content}
+        struct ExternalVisitor {
+            using Value = std::variant<Ts...>;
+            template<typename A> // MapAccess
+            ftl::Result<Value, typename A::Error>
+            visit_map(A map) {
+                ftl::Option<size_t> index = TRY(map.next_key_seed(VariantTag<Value>{}));
+                if (index.is_none()) return ftl::Err(A::Error::invalid_length(0));
+                Value value = TRY(map.next_value_seed(VariantContent<Value>{index.unwrap()}));
+                ftl::Option<ftl::str> extra = TRY(map.template next_key<ftl::str>());
+                if (extra.is_some()) return ftl::Err(A::Error::invalid_length(2));
+                return ftl::Ok(std::move(value));
+            }
+        };
+        // {"type": "Name", "content": content}, the tag has to come first
+        struct AdjacentVisitor {
+            using Value = std::variant<Ts...>;
+            template<typename A> // MapAccess
+            ftl::Result<Value, typename A::Error>
+            visit_map(A map) {
+                ftl::Option<ftl::str> key = TRY(map.template next_key<ftl::str>());
+                if (key.is_none() || !detail::name_eq(key.unwrap(), Repr::tag)) {
+                    return ftl::Err(A::Error::missing_field(Repr::tag));
+                }
+                size_t index = TRY(map.next_value_seed(VariantTag<Value>{}));
+                key = TRY(map.template next_key<ftl::str>());
+                if (key.is_none() || !detail::name_eq(key.unwrap(), Repr::content)) {
+                    return ftl::Err(A::Error::missing_field(Repr::content));
+                }
+                Value value = TRY(map.next_value_seed(VariantContent<Value>{index}));
+                key = TRY(map.template next_key<ftl::str>());
+                if (key.is_some()) {
+                    return ftl::Err(A::Error::unknown_field(key.unwrap(), ADJACENT_FIELDS));
+                }
+                return ftl::Ok(std::move(value));
+            }
+        };
+        struct InternalVisitor {
+            using Value = std::variant<Ts...>;
+            // The tag was the first key: map holds the entries after it and
+            // goes straight into the alternative's map Visitor
+            template<typename A> // MapAccess
+            ftl::Result<Value, typename A::Error>
+            visit_tagged_map(ftl::str name, A map) {
+                size_t index = index_of(name);
+                if (index == sizeof...(Ts)) {
+                    return ftl::Err(A::Error::unknown_variant(name, NAMES));
+                }
+                return ENTRIES_TABLE<A>[index](map);
+            }
+            // The tag came later: rest is back at the start of the object
+            template<typename D>
+            ftl::Result<Value, typename D::Error>
+            visit_tagged(ftl::str name, D &rest) {
+                size_t index = index_of(name);
+                if (index == sizeof...(Ts)) {
+                    return ftl::Err(D::Error::unknown_variant(name, NAMES));
+                }
+                return TABLE<D>[index](rest);
+            }
+        };
+    };
+
+    template<typename... Ts>
+    struct DeserializeSeed<VariantTag<std::variant<Ts...>>> {
+        using Value = size_t;
+        using Variant = Deserialize<std::variant<Ts...>>;
+
+        template<typename D>
+        static ftl::Result<size_t, typename D::Error>
+        deserialize(const VariantTag<std::variant<Ts...>> &self, D &deserializer) {
+            (void)self;
+            struct TagVisitor {
+                using Value = size_t;
+                ftl::Result<Value, typename D::Error>
+                visit_str(ftl::str name) {
+                    size_t index = Variant::index_of(name);
+                    if (index == sizeof...(Ts)) {
+                        return ftl::Err(D::Error::unknown_variant(name, Variant::NAMES));
+                    }
+                    return ftl::Ok(index);
+                }
+            };
+            return deserializer.deserialize_identifier(TagVisitor{});
+        }
+    };
+    template<typename... Ts>
+    struct DeserializeSeed<VariantContent<std::variant<Ts...>>> {
+        using Value = std::variant<Ts...>;
+        using Variant = Deserialize<std::variant<Ts...>>;
+
+        template<typename D>
+        static ftl::Result<Value, typename D::Error>
+        deserialize(const VariantContent<Value> &self, D &deserializer) {
+            return Variant::template TABLE<D>[self.index](deserializer);
+        }
+    };
 }
 
 namespace de::concepts {
@@ -358,11 +811,19 @@ namespace de::concepts {
         -> std::same_as<ftl::Result<T, typename D::Error>>;
     };
 
-    // template<typename T, typename D = detail::archetypes::de::Deserializer>
-    // concept DeserializeSeed = requires(const T &seed, D &deserializer) {
-    //     { DeserializeSeed<T>::deserialize(seed, deserializer) }
-    //     -> std::same_as<ftl::Result<T, typename D::Error>>;
-    // };
+    /**
+     * @brief   S is a seed: a value whose DeserializeSeed specialization
+     *          deserializes a Value with it
+     * @details The seed carries the state, a table to intern into or a
+     *          container to append to, so the Value does not have to be S.
+     */
+    template<typename S, typename D = detail::archetypes::de::Deserializer>
+    concept DeserializeSeed = requires(const S &seed, D &deserializer) {
+        typename de::DeserializeSeed<S>::Value;
+        { de::DeserializeSeed<S>::deserialize(seed, deserializer) }
+        -> std::same_as<ftl::Result<typename de::DeserializeSeed<S>::Value,
+                                    typename D::Error>>;
+    };
 }
 }
 
@@ -0,0 +1,324 @@
+#ifndef SERDE_FIELDS_H_
+#define SERDE_FIELDS_H_
+
+#include <array>
+#include <cstddef>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include <ftl.hpp>
+
+#include "serde/de.hpp"
+#include "serde/ser.hpp"
+#include "serde/variant.hpp"
+
+namespace serde {
+    // String literal usable as a template argument
+    template<size_t N>
+    struct fixed_string {
+        char data[N] = {};
+
+        constexpr fixed_string() = default;
+        constexpr fixed_string(const char (&str)[N]) {
+            for (size_t i = 0; i < N; i++) data[i] = str[i];
+        }
+        constexpr size_t size() const { return N - 1; }
+    };
+
+    template<size_t N>
+    constexpr fixed_string<N + 2> quote(const fixed_string<N> &str) {
+        fixed_string<N + 2> res;
+        res.data[0] = '"';
+        for (size_t i = 0; i < str.size(); i++) res.data[i + 1] = str.data[i];
+        res.data[N] = '"';
+        return res;
+    }
+
+    /**
+     * @brief   Key of a struct field
+     * @details Converts to the plain name, so any SerializeStruct takes it.
+     *          Formats that write keys as JSON strings can use `quoted`,
+     *          which already has the quotes around it.
+     */
+    struct FieldKey {
+        ftl::str name;
+        std::string_view quoted;
+
+        constexpr operator ftl::str() const { return name; }
+    };
+
+    template<typename M>
+    struct member_pointer;
+    template<typename C, typename T>
+    struct member_pointer<T C::*> {
+        using Owner = C;
+        using Type = T;
+    };
+
+    template<typename T>
+    struct is_option : std::false_type {};
+    template<typename T>
+    struct is_option<ftl::Option<T>> : std::true_type {};
+
+    /**
+     * @brief   Attributes of a field, or-ed into the last argument of Field
+     * @details SKIP_IF_NONE leaves an ftl::Option field out of the output
+     *          when it is None instead of writing null, and reads a missing
+     *          one back as None, so the output always decodes. DEFAULT lets
+     *          the field be missing from the input, it then keeps the value
+     *          it has in a value-initialized struct.
+     */
+    enum FieldAttr : unsigned {
+        SKIP_IF_NONE = 1 << 0,
+        DEFAULT = 1 << 1,
+    };
+
+    /**
+     * @brief Descriptor of one struct field: Field<"r", &RGB::r>
+     */
+    template<fixed_string Name, auto Member, unsigned Attrs = 0>
+    struct Field {
+        using Owner = typename member_pointer<decltype(Member)>::Owner;
+        using Type = typename member_pointer<decltype(Member)>::Type;
+
+        static constexpr bool skip_if_none = Attrs & SKIP_IF_NONE;
+        static constexpr bool default_if_missing = Attrs & (DEFAULT | SKIP_IF_NONE);
+        static_assert(!skip_if_none || is_option<Type>::value,
+                "skip_if_none needs an ftl::Option field");
+
+        static constexpr auto member = Member;
+        static constexpr fixed_string quoted = quote(Name);
+        static constexpr FieldKey key = {
+            Name.data,
+            std::string_view(quoted.data, quoted.size()),
+        };
+    };
+
+    /**
+     * @brief   Field table of a struct: Fields<RGB, Field<"r", &RGB::r>, ...>
+     * @details Written once per type, by the derive macros or by hand, and
+     *          walked with fold expressions by ser::SerializeFields and
+     *          de::DeserializeFields. The derives of one type spell the same
+     *          table, so they share everything instantiated from it.
+     */
+    template<typename T, typename... Fs>
+    struct Fields {
+        static_assert(sizeof...(Fs) > 0, "a struct needs at least one field");
+        static_assert((std::is_same_v<typename Fs::Owner, T> && ...),
+                "field of another struct");
+
+        static constexpr size_t COUNT = sizeof...(Fs);
+        static constexpr ftl::str NAMES[] = { Fs::key.name... };
+        static constexpr bool DEFAULTED[] = { Fs::default_if_missing... };
+        // Field indices ordered by name, for serializers that sort keys
+        static constexpr std::array<size_t, COUNT> SORTED = [] {
+            constexpr std::string_view names[] = {
+                Fs::key.quoted.substr(1, Fs::key.quoted.size() - 2)...
+            };
+            std::array<size_t, COUNT> order{};
+            for (size_t i = 0; i < COUNT; i++) {
+                size_t j = i;
+                for (; j > 0 && names[i] < names[order[j - 1]]; j--) order[j] = order[j - 1];
+                order[j] = i;
+            }
+            return order;
+        }();
+
+        // Formats mostly keep the declaration order, so the field after the
+        // previous one is tried before looking at the rest. COUNT if unknown.
+        static size_t index_of(const ftl::str &name, size_t hint) {
+            if (hint < COUNT && detail::name_eq(NAMES[hint], name)) return hint;
+            for (size_t i = 0; i < COUNT; i++) {
+                if (detail::name_eq(NAMES[i], name)) return i;
+            }
+            return COUNT;
+        }
+    };
+
+namespace ser {
+    template<typename L>
+    struct SerializeFields;
+
+    template<typename T, typename... Fs>
+    struct SerializeFields<Fields<T, Fs...>> {
+        template<Serializer S>
+        static ftl::Result<typename S::Ok, typename S::Error>
+        serialize(const ftl::str &name, const T &self, S &serializer) {
+            typename S::SerializeStruct &state =
+                TRY(serializer.serialize_struct(name, (written<Fs>(self) + ...)));
+            if constexpr (sorts_keys<S>) {
+                TRY(serialize_sorted(self, state, std::index_sequence_for<Fs...>{}));
+            } else {
+                TRY(serialize_fields<Fs...>(self, state));
+            }
+            return state.end();
+        }
+        // The order is fixed at compile time, sorting costs nothing per call
+        template<typename State, size_t... Is>
+        static ftl::Result<void, typename State::Error>
+        serialize_sorted(const T &self, State &state, std::index_sequence<Is...>) {
+            using L = Fields<T, Fs...>;
+            return serialize_fields<std::tuple_element_t<L::SORTED[Is], std::tuple<Fs...>>...>(
+                    self, state);
+        }
+        template<typename F>
+        static size_t written(const T &self) {
+            if constexpr (F::skip_if_none) {
+                return (self.*F::member).is_some();
+            } else {
+                return 1;
+            }
+        }
+        // TRY can not sit in a fold expression, so this unrolls by recursion
+        template<typename F, typename... Rest, typename State>
+        static ftl::Result<void, typename State::Error>
+        serialize_fields(const T &self, State &state) {
+            if (written<F>(self)) TRY(state.serialize_field(F::key, self.*F::member));
+            if constexpr (sizeof...(Rest) > 0) {
+                return serialize_fields<Rest...>(self, state);
+            } else {
+                return ftl::Ok();
+            }
+        }
+    };
+}
+
+namespace de {
+    // Seed reading a field name as its index in L
+    template<typename L>
+    struct FieldSeed {
+        size_t hint;
+    };
+    template<typename T, typename... Fs>
+    struct DeserializeSeed<FieldSeed<Fields<T, Fs...>>> {
+        using Value = size_t;
+        using L = Fields<T, Fs...>;
+
+        template<typename D>
+        static ftl::Result<size_t, typename D::Error>
+        deserialize(const FieldSeed<L> &self, D &deserializer) {
+            struct FieldVisitor {
+                using Value = size_t;
+                size_t hint;
+                ftl::Result<Value, typename D::Error>
+                visit_str(ftl::str name) {
+                    size_t index = L::index_of(name, hint);
+                    if (index == L::COUNT) {
+                        return ftl::Err(D::Error::unknown_field(name, L::NAMES));
+                    }
+                    return ftl::Ok(index);
+                }
+            };
+            return deserializer.deserialize_identifier(FieldVisitor{self.hint});
+        }
+    };
+
+    template<typename L>
+    struct DeserializeFields;
+
+    /**
+     * @brief   Map visitor of a struct described by Fields
+     * @details Values are held in a tuple of Options until the map ends.
+     *          T is then brace-initialized from them in the order of Fields,
+     *          like the designated initializers the derive used to write,
+     *          so const members work and T needs no default constructor.
+     *          Fields has to follow the declaration order, members after
+     *          the last one keep their default member initializers. A DEFAULT
+     *          field missing from the input gets the value it has in a
+     *          value-initialized T, or a value-initialized one if T has
+     *          no default constructor. A missing SKIP_IF_NONE field is None.
+     *          A T that can not be brace-initialized that way, such as a
+     *          class with constructors, is value-initialized and assigned
+     *          through the member pointers instead.
+     */
+    template<typename T, typename... Fs>
+    struct DeserializeFields<Fields<T, Fs...>> {
+        using L = Fields<T, Fs...>;
+        template<typename F>
+        using Stored = std::remove_cv_t<typename F::Type>;
+        using Slots = std::tuple<ftl::Option<Stored<Fs>>...>;
+        static constexpr bool BRACED = requires { T{std::declval<Stored<Fs>>()...}; };
+        static_assert(BRACED || std::is_default_constructible_v<T>,
+                "derived Deserialize needs a struct initializable from its fields");
+
+        template<size_t I, typename A>
+        static ftl::Result<void, typename A::Error> read_field(Slots &slots, A &map) {
+            using Type = std::tuple_element_t<I, std::tuple<Stored<Fs>...>>;
+            auto &slot = std::get<I>(slots);
+            if (slot.is_some()) return ftl::Err(A::Error::duplicate_field(L::NAMES[I]));
+            slot = ftl::Some(TRY(map.template next_value<Type>()));
+            return ftl::Ok();
+        }
+        template<typename A>
+        using ReadField = ftl::Result<void, typename A::Error> (*)(Slots &, A &);
+        template<typename A, size_t... Is>
+        static constexpr std::array<ReadField<A>, sizeof...(Fs)>
+        read_table(std::index_sequence<Is...>) {
+            return { &read_field<Is, A>... };
+        }
+        template<typename A>
+        static constexpr auto READ_TABLE = read_table<A>(std::index_sequence_for<Fs...>{});
+
+        template<typename A, size_t... Is>
+        static ftl::Result<T, typename A::Error>
+        build(Slots &slots, std::index_sequence<Is...>) {
+            size_t missing = 0;
+            if (((!Fs::default_if_missing && std::get<Is>(slots).is_none()
+                            && (missing = Is, true)) || ...)) {
+                return ftl::Err(A::Error::missing_field(L::NAMES[missing]));
+            }
+            if constexpr (BRACED) {
+                return ftl::Ok(T{take<Fs>(std::get<Is>(slots))...});
+            } else {
+                T value{};
+                (assign<Fs>(value, std::get<Is>(slots)), ...);
+                return ftl::Ok(std::move(value));
+            }
+        }
+        template<typename F>
+        static Stored<F> take(ftl::Option<Stored<F>> &slot) {
+            if constexpr (F::default_if_missing) {
+                if (slot.is_none()) {
+                    if constexpr (F::skip_if_none) {
+                        return Stored<F>(ftl::None());
+                    } else if constexpr (std::is_default_constructible_v<T>) {
+                        return T{}.*F::member;
+                    } else {
+                        return Stored<F>{};
+                    }
+                }
+            }
+            return std::move(slot).unwrap();
+        }
+        template<typename F>
+        static void assign(T &value, ftl::Option<Stored<F>> &slot) {
+            if (F::default_if_missing && slot.is_none()) {
+                if constexpr (F::skip_if_none) value.*F::member = ftl::None();
+                return;
+            }
+            value.*F::member = std::move(slot).unwrap();
+        }
+
+        struct Visitor {
+            using Value = T;
+            template<typename A> // MapAccess
+            ftl::Result<Value, typename A::Error> visit_map(A map) {
+                Slots slots{ftl::Option<Stored<Fs>>(ftl::None())...};
+                size_t hint = 0;
+                for (auto index = TRY(map.next_key_seed(FieldSeed<L>{hint}));
+                        index.is_some();
+                        index = TRY(map.next_key_seed(FieldSeed<L>{hint}))) {
+                    size_t i = index.unwrap();
+                    TRY(READ_TABLE<A>[i](slots, map));
+                    hint = i + 1;
+                }
+                return build<A>(slots, std::index_sequence_for<Fs...>{});
+            }
+        };
+    };
+}
+}
+
+#endif // !SERDE_FIELDS_H_
@@ -0,0 +1,88 @@
+#ifndef SERDE_FLAT_MAP_H_
+#define SERDE_FLAT_MAP_H_
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace serde {
+    /**
+     * @brief   Map stored as a vector of entries sorted by key
+     * @details Lookups are heterogeneous: with the default std::less<> a
+     *          FlatMap<std::string, V> can be searched with a string_view
+     *          or ftl::str without building a key. Bulk loads append with
+     *          push_back and restore the order once with sort_unique().
+     */
+    template<typename K, typename V, typename Compare = std::less<>>
+    struct FlatMap {
+        using key_type = K;
+        using mapped_type = V;
+        using value_type = std::pair<K, V>;
+        using iterator = typename std::vector<value_type>::iterator;
+        using const_iterator = typename std::vector<value_type>::const_iterator;
+
+        std::vector<value_type> entries;
+        [[no_unique_address]] Compare compare;
+
+        iterator begin() { return entries.begin(); }
+        iterator end() { return entries.end(); }
+        const_iterator begin() const { return entries.begin(); }
+        const_iterator end() const { return entries.end(); }
+        size_t size() const { return entries.size(); }
+        bool empty() const { return entries.empty(); }
+        void reserve(size_t n) { entries.reserve(n); }
+
+        template<typename Q>
+        iterator lower_bound(const Q &key) {
+            return std::lower_bound(entries.begin(), entries.end(), key,
+                    [&](const value_type &entry, const Q &key) {
+                        return compare(entry.first, key);
+                    });
+        }
+        template<typename Q>
+        const_iterator lower_bound(const Q &key) const {
+            return const_cast<FlatMap *>(this)->lower_bound(key);
+        }
+        template<typename Q>
+        iterator find(const Q &key) {
+            auto it = lower_bound(key);
+            return it != end() && !compare(key, it->first) ? it : end();
+        }
+        template<typename Q>
+        const_iterator find(const Q &key) const {
+            return const_cast<FlatMap *>(this)->find(key);
+        }
+
+        std::pair<iterator, bool> insert_or_assign(K key, V value) {
+            auto it = lower_bound(key);
+            if (it != end() && !compare(key, it->first)) {
+                it->second = std::move(value);
+                return {it, false};
+            }
+            it = entries.emplace(it, std::move(key), std::move(value));
+            return {it, true};
+        }
+        // Appends without keeping the order, call sort_unique() afterwards
+        void push_back(K key, V value) {
+            entries.emplace_back(std::move(key), std::move(value));
+        }
+        // Sorts appended entries, the last of equal keys wins
+        void sort_unique() {
+            std::stable_sort(entries.begin(), entries.end(),
+                    [&](const value_type &a, const value_type &b) {
+                        return compare(a.first, b.first);
+                    });
+            auto out = entries.begin();
+            for (auto it = entries.begin(); it != entries.end(); ++it) {
+                auto next = it + 1;
+                if (next != entries.end() && !compare(it->first, next->first)) continue;
+                if (out != it) *out = std::move(*it);
+                ++out;
+            }
+            entries.erase(out, entries.end());
+        }
+    };
+}
+
+#endif // !SERDE_FLAT_MAP_H_
@@ -0,0 +1,194 @@
+#ifndef SERDE_INTERN_H_
+#define SERDE_INTERN_H_
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#include <ftl.hpp>
+
+#include "serde/de.hpp"
+#include "serde/ser.hpp"
+#include "serde/validate.hpp"
+
+namespace serde {
+    /**
+     * @brief   Handle to a string held by an InternPool
+     * @details Equal strings interned into one pool share one copy and get
+     *          the same handle, so comparing handles compares pointers.
+     *          Valid as long as the pool is.
+     */
+    struct Interned {
+        static constexpr char EMPTY[1] = {};
+
+        const char *data = EMPTY;
+        size_t size = 0;
+
+        ftl::str str() const { return ftl::str(data, size); }
+        std::string_view view() const { return std::string_view(data, size); }
+        bool operator==(const Interned &other) const {
+            return data == other.data && size == other.size;
+        }
+    };
+
+    /**
+     * @brief   Thread-safe set of strings, each stored once
+     * @details Strings are spread over SHARDS shards by hash, each with its
+     *          own mutex, so threads decoding different documents rarely
+     *          wait on each other. A shard copies its strings into blocks
+     *          it never frees or moves, which is what keeps handles stable.
+     *          Nothing is ever removed: the pool is meant for values drawn
+     *          from a small set (status codes, regions, type tags), a high
+     *          cardinality field only pays the hashing on top of the copy.
+     */
+    struct InternPool {
+        static constexpr size_t SHARDS = 16;
+        // Blocks double from MIN_BLOCK, a pool of a few strings stays small
+        static constexpr size_t MIN_BLOCK = 1024;
+        static constexpr size_t MAX_BLOCK = 64 * 1024;
+
+        Interned intern(ftl::str value) {
+            if (value.len() == 0) return Interned{};
+            std::string_view view(&*value.begin(), value.len());
+            size_t hash = std::hash<std::string_view>{}(view);
+            Shard &shard = shards[hash % SHARDS];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.strings.find(Entry{view, hash});
+            if (it == shard.strings.end()) {
+                it = shard.strings.insert(Entry{shard.copy(view), hash}).first;
+            }
+            return Interned{it->view.data(), it->view.size()};
+        }
+        // Distinct strings held
+        size_t size() const {
+            size_t res = 0;
+            for (const Shard &shard : shards) {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                res += shard.strings.size();
+            }
+            return res;
+        }
+        // Bytes of string storage allocated, the sets' own nodes excluded
+        size_t bytes() const {
+            size_t res = 0;
+            for (const Shard &shard : shards) {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                res += shard.allocated;
+            }
+            return res;
+        }
+
+        // Pool behind Deserialize<Interned>
+        static InternPool &global() {
+            static InternPool pool;
+            return pool;
+        }
+
+    private:
+        // Key of a shard's set, hashed once by intern()
+        struct Entry {
+            std::string_view view;
+            size_t hash;
+
+            bool operator==(const Entry &other) const { return view == other.view; }
+        };
+        struct EntryHash {
+            size_t operator()(const Entry &entry) const { return entry.hash; }
+        };
+        struct Shard {
+            mutable std::mutex mutex;
+            std::unordered_set<Entry, EntryHash> strings;
+            std::vector<std::unique_ptr<char[]>> blocks;
+            char *cursor = nullptr;
+            size_t left = 0;
+            size_t allocated = 0;
+            size_t next_block = MIN_BLOCK;
+
+            std::string_view copy(std::string_view value) {
+                if (value.size() > left) {
+                    // Long strings get a block of their own, the current one stays open
+                    if (value.size() > next_block / 4) {
+                        blocks.push_back(std::make_unique_for_overwrite<char[]>(value.size()));
+                        allocated += value.size();
+                        memcpy(blocks.back().get(), value.data(), value.size());
+                        return std::string_view(blocks.back().get(), value.size());
+                    }
+                    blocks.push_back(std::make_unique_for_overwrite<char[]>(next_block));
+                    allocated += next_block;
+                    cursor = blocks.back().get();
+                    left = next_block;
+                    next_block = std::min(next_block * 2, MAX_BLOCK);
+                }
+                memcpy(cursor, value.data(), value.size());
+                std::string_view res(cursor, value.size());
+                cursor += value.size();
+                left -= value.size();
+                return res;
+            }
+        };
+        std::array<Shard, SHARDS> shards;
+    };
+
+namespace de {
+    /**
+     * @brief   Seed reading a string into pool
+     * @details The string is hashed straight from the input and only copied
+     *          the first time the pool sees it.
+     */
+    struct InternSeed {
+        InternPool *pool;
+    };
+    template<>
+    struct DeserializeSeed<InternSeed> {
+        using Value = Interned;
+
+        template<typename D>
+        static ftl::Result<Interned, typename D::Error>
+        deserialize(const InternSeed &self, D &deserializer) {
+            struct InternVisitor {
+                using Value = Interned;
+                InternPool *pool;
+                ftl::Result<Value, typename D::Error>
+                visit_str(ftl::str value) {
+                    return ftl::Ok(pool->intern(value));
+                }
+            };
+            return deserializer.deserialize_str(InternVisitor{self.pool});
+        }
+    };
+
+    // Fields of derived structs intern into the global pool
+    template<>
+    struct Deserialize<Interned> {
+        template<concepts::Deserializer D>
+        static ftl::Result<Interned, typename D::Error>
+        deserialize(D &deserializer) {
+            return DeserializeSeed<InternSeed>::deserialize(
+                    InternSeed{&InternPool::global()}, deserializer);
+        }
+    };
+    // Checking the input must not grow the pool
+    template<>
+    struct Validate<Interned> : Validate<ftl::str> {};
+}
+
+namespace ser {
+    template<>
+    struct Serialize<Interned> {
+        template<Serializer S>
+        static ftl::Result<typename S::Ok, typename S::Error>
+        serialize(const Interned &self, S &serializer) {
+            return serializer.serialize_str(self.str());
+        }
+    };
+}
+}
+
+#endif // !SERDE_INTERN_H_
@@ -1,21 +1,31 @@
 #ifndef SERDE_SER_H_
 #define SERDE_SER_H_
 
+#include <algorithm>
 #include <array>
+#include <charconv>
 #include <concepts>
+#include <cstdint>
 #include <string>
+#include <string_view>
 
 #include "fst/fst.hpp"
+#include "serde/flat_map.hpp"
+#include "serde/variant.hpp"
 #include <ftl.hpp>
+#include <map>
 #include <type_traits>
+#include <unordered_map>
+#include <variant>
 #include <vector>
 
 namespace serde {
 namespace ser {
     template<typename Self>
     concept Error = fst::error::Error<Self>
-                 && requires(Self err, const char *msg) {
-        { Self::custom(msg) } -> std::same_as<Self>;
+                 && requires(Self err) {
+        // Messages are string literals, an error may keep just the pointer
+        { Self::custom("") } -> std::same_as<Self>;
     };
 }
 
@@ -44,21 +54,44 @@ namespace detail::archetypes::ser {
         
         ftl::Result<Ok, Error> end_seq();
     };
+    struct SerializeMap {
+        using Ok = void;
+        using Error = Error;
+
+        template<typename T>
+        ftl::Result<void, Error>
+        serialize_key(const T &key);
+        template<typename T>
+        ftl::Result<void, Error>
+        serialize_value(const T &value);
+
+        ftl::Result<Ok, Error> end_map();
+    };
     struct Serializer {
         using Ok = void;
         using Error = Error;
         using SerializeStruct = SerializeStruct;
         using SerializeSeq = SerializeSeq;
+        using SerializeMap = SerializeMap;
+
+        ftl::Result<Ok, Error> serialize_unit();
 
         ftl::Result<Ok, Error> serialize_bool(const bool &);
 
         ftl::Result<Ok, Error> serialize_char(const char &);
 
+        ftl::Result<Ok, Error> serialize_schar(const signed char &);
         ftl::Result<Ok, Error> serialize_short(const short &);
         ftl::Result<Ok, Error> serialize_int(const int &);
         ftl::Result<Ok, Error> serialize_long(const long &);
         ftl::Result<Ok, Error> serialize_long_long(const long long &);
 
+        ftl::Result<Ok, Error> serialize_uchar(const unsigned char &);
+        ftl::Result<Ok, Error> serialize_ushort(const unsigned short &);
+        ftl::Result<Ok, Error> serialize_uint(const unsigned int &);
+        ftl::Result<Ok, Error> serialize_ulong(const unsigned long &);
+        ftl::Result<Ok, Error> serialize_ulong_long(const unsigned long long &);
+
         ftl::Result<Ok, Error> serialize_float(const float&);
         ftl::Result<Ok, Error> serialize_double(const double&);
 
@@ -68,6 +101,8 @@ namespace detail::archetypes::ser {
         serialize_struct(const ftl::str &, const size_t);
         ftl::Result<SerializeSeq &, Error>
         serialize_seq(ftl::Option<size_t>);
+        ftl::Result<SerializeMap &, Error>
+        serialize_map(ftl::Option<size_t>);
     };
     struct Serialize;
 }
@@ -99,14 +134,35 @@ namespace ser {
         ftl::Result<typename S::Ok, typename S::Error>>;
     };
     template<typename S>
+    concept SerializeMap =
+    requires(S serializer,
+             const detail::archetypes::ser::Serialize &key,
+             const detail::archetypes::ser::Serialize &value) {
+        typename S::Ok;
+        requires ser::Error<typename S::Error>;
+
+        { serializer.serialize_key(key) } -> std::same_as<
+        ftl::Result<void, typename S::Error>>;
+        { serializer.serialize_value(value) } -> std::same_as<
+        ftl::Result<void, typename S::Error>>;
+        { serializer.end_map() } -> std::same_as<
+        ftl::Result<typename S::Ok, typename S::Error>>;
+    };
+    template<typename S>
     concept Serializer =
     requires(S serializer,
              const bool &Bool,
              const char &Char,
+             const signed char &SChar,
              const short &Short,
              const int &Int,
              const long &Long,
              const long long &LongLong,
+             const unsigned char &UChar,
+             const unsigned short &UShort,
+             const unsigned int &UInt,
+             const unsigned long &ULong,
+             const unsigned long long &ULongLong,
              const float &Float,
              const double &Double,
              const ftl::str &Str,
@@ -118,6 +174,10 @@ namespace ser {
 
         requires SerializeStruct<typename S::SerializeStruct>;
         requires SerializeSeq<typename S::SerializeSeq>;
+        requires SerializeMap<typename S::SerializeMap>;
+
+        { serializer.serialize_unit() } -> std::same_as<
+        ftl::Result<typename S::Ok, typename S::Error>>;
 
         { serializer.serialize_bool(Bool) } -> std::same_as<
         ftl::Result<typename S::Ok, typename S::Error>>;
@@ -125,6 +185,8 @@ namespace ser {
         { serializer.serialize_char(Char) } -> std::same_as<
         ftl::Result<typename S::Ok, typename S::Error>>;
 
+        { serializer.serialize_schar(SChar) } -> std::same_as<
+        ftl::Result<typename S::Ok, typename S::Error>>;
         { serializer.serialize_short(Short) } -> std::same_as<
         ftl::Result<typename S::Ok, typename S::Error>>;
         { serializer.serialize_int(Int) } -> std::same_as<
@@ -134,6 +196,17 @@ namespace ser {
         { serializer.serialize_long_long(LongLong) } -> std::same_as<
         ftl::Result<typename S::Ok, typename S::Error>>;
 
+        { serializer.serialize_uchar(UChar) } -> std::same_as<
+        ftl::Result<typename S::Ok, typename S::Error>>;
+        { serializer.serialize_ushort(UShort) } -> std::same_as<
+        ftl::Result<typename S::Ok, typename S::Error>>;
+        { serializer.serialize_uint(UInt) } -> std::same_as<
+        ftl::Result<typename S::Ok, typename S::Error>>;
+        { serializer.serialize_ulong(ULong) } -> std::same_as<
+        ftl::Result<typename S::Ok, typename S::Error>>;
+        { serializer.serialize_ulong_long(ULongLong) } -> std::same_as<
+        ftl::Result<typename S::Ok, typename S::Error>>;
+
         { serializer.serialize_float(Float) } -> std::same_as<
         ftl::Result<typename S::Ok, typename S::Error>>;
         { serializer.serialize_double(Double) } -> std::same_as<
@@ -146,10 +219,22 @@ namespace ser {
         ftl::Result<typename S::SerializeStruct &, typename S::Error>>;
         { serializer.serialize_seq(opt_len) } -> std::same_as<
         ftl::Result<typename S::SerializeSeq &, typename S::Error>>;
+        { serializer.serialize_map(opt_len) } -> std::same_as<
+        ftl::Result<typename S::SerializeMap &, typename S::Error>>;
     };
 }
 
 namespace ser {
+    /**
+     * @brief   Whether S wants struct fields and map entries in key order
+     * @details A serializer opts in with `static constexpr bool SORT_KEYS`.
+     *          Derived structs then write their fields in the order Fields
+     *          sorted at compile time, and serialize_map_entries sorts the
+     *          entries of a map, see detail::key_less.
+     */
+    template<typename S>
+    constexpr bool sorts_keys = requires { requires S::SORT_KEYS; };
+
     template<typename T>
     struct Serialize;
 
@@ -178,6 +263,22 @@ namespace ser {
         }
     };
     template<>
+    struct Serialize<char> {
+        template<Serializer S>
+        static ftl::Result<typename S::Ok, typename S::Error>
+        serialize(const char &self, S &serializer) {
+            return serializer.serialize_char(self);
+        }
+    };
+    template<>
+    struct Serialize<signed char> {
+        template<Serializer S>
+        static ftl::Result<typename S::Ok, typename S::Error>
+        serialize(const signed char &self, S &serializer) {
+            return serializer.serialize_schar(self);
+        }
+    };
+    template<>
     struct Serialize<short> {
         template<Serializer S>
         static ftl::Result<typename S::Ok, typename S::Error>
@@ -209,6 +310,46 @@ namespace ser {
             return serializer.serialize_long_long(self);
         }
     };
+    template<>
+    struct Serialize<unsigned char> {
+        template<Serializer S>
+        static ftl::Result<typename S::Ok, typename S::Error>
+        serialize(const unsigned char &self, S &serializer) {
+            return serializer.serialize_uchar(self);
+        }
+    };
+    template<>
+    struct Serialize<unsigned short> {
+        template<Serializer S>
+        static ftl::Result<typename S::Ok, typename S::Error>
+        serialize(const unsigned short &self, S &serializer) {
+            return serializer.serialize_ushort(self);
+        }
+    };
+    template<>
+    struct Serialize<unsigned int> {
+        template<Serializer S>
+        static ftl::Result<typename S::Ok, typename S::Error>
+        serialize(const unsigned int &self, S &serializer) {
+            return serializer.serialize_uint(self);
+        }
+    };
+    template<>
+    struct Serialize<unsigned long> {
+        template<Serializer S>
+        static ftl::Result<typename S::Ok, typename S::Error>
+        serialize(const unsigned long &self, S &serializer) {
+            return serializer.serialize_ulong(self);
+        }
+    };
+    template<>
+    struct Serialize<unsigned long long> {
+        template<Serializer S>
+        static ftl::Result<typename S::Ok, typename S::Error>
+        serialize(const unsigned long long &self, S &serializer) {
+            return serializer.serialize_ulong_long(self);
+        }
+    };
 
     template<>
     struct Serialize<float> {
@@ -236,6 +377,15 @@ namespace ser {
         }
     };
 
+    template<>
+    struct Serialize<std::string> {
+        template<Serializer S>
+        static ftl::Result<typename S::Ok, typename S::Error>
+        serialize(const std::string &self, S &serializer) {
+            return serializer.serialize_str(ftl::str(self.data(), self.size()));
+        }
+    };
+
     template<concepts::Serialize T>
     struct Serialize<ftl::Slice<T>> {
         template<Serializer S>
@@ -288,7 +438,244 @@ namespace ser {
             return state.end_seq();
         }
     };
-    
+}
+
+namespace detail {
+    inline std::string_view key_view(const ftl::str &key) {
+        return key.len() ? std::string_view(&*key.begin(), key.len()) : std::string_view();
+    }
+    inline std::string_view key_view(std::string_view key) { return key; }
+
+    /**
+     * @brief   Order of map keys as their text: the bytes of a string,
+     *          the decimal digits of a number
+     * @details Numbers have to be compared as text, -1 comes before -2
+     *          and 10 before 9 in the output. std::string compares its
+     *          chars as unsigned, like the views do.
+     */
+    template<typename K>
+    bool key_less(const K &a, const K &b) {
+        if constexpr (std::is_same_v<K, bool>) {
+            return a < b;
+        } else if constexpr (std::is_same_v<K, char>) {
+            return (unsigned char)a < (unsigned char)b;
+        } else if constexpr (std::is_arithmetic_v<K>) {
+            char text_a[32], text_b[32];
+            char *end_a = std::to_chars(text_a, text_a + sizeof(text_a), a).ptr;
+            char *end_b = std::to_chars(text_b, text_b + sizeof(text_b), b).ptr;
+            return std::string_view(text_a, end_a - text_a)
+                 < std::string_view(text_b, end_b - text_b);
+        } else if constexpr (requires { key_view(a); }) {
+            return key_view(a) < key_view(b);
+        } else {
+            return a < b;
+        }
+    }
+
+    // First eight bytes of key, big endian so integers order like the bytes
+    inline uint64_t key_prefix(std::string_view key) {
+        uint64_t res = 0;
+        size_t n = std::min<size_t>(key.size(), 8);
+        for (size_t i = 0; i < n; i++) res |= (uint64_t)(unsigned char)key[i] << (56 - 8 * i);
+        return res;
+    }
+
+    /**
+     * @brief   Entries of a map sorted by key_less, kept on the stack up to INLINE
+     * @details String keys are sorted by a prefix and a view held next to
+     *          the entry pointer, most comparisons are decided by the
+     *          prefix without touching the key's bytes.
+     */
+    template<typename M, ser::Serializer S>
+    ftl::Result<typename S::Ok, typename S::Error>
+    serialize_sorted_entries(const M &self, S &serializer) {
+        using Node = std::remove_reference_t<decltype(*self.begin())>;
+        using Key = std::remove_cvref_t<decltype(self.begin()->first)>;
+        constexpr bool BY_VIEW = requires(const Key &key) { key_view(key); };
+        struct Entry {
+            const Node *node;
+            std::conditional_t<BY_VIEW, std::string_view, const Key *> key;
+            uint64_t prefix = 0;
+            bool operator<(const Entry &other) const {
+                if constexpr (BY_VIEW) {
+                    if (prefix != other.prefix) return prefix < other.prefix;
+                    return key < other.key;
+                } else {
+                    return key_less(*key, *other.key);
+                }
+            }
+        };
+        constexpr size_t INLINE = 32;
+        Entry local[INLINE];
+        std::vector<Entry> spilled;
+        Entry *entries = local;
+        if (self.size() > INLINE) {
+            spilled.resize(self.size());
+            entries = spilled.data();
+        }
+        size_t n = 0;
+        for (auto &node : self) {
+            if constexpr (BY_VIEW) {
+                std::string_view key = key_view(node.first);
+                entries[n++] = Entry{&node, key, key_prefix(key)};
+            } else {
+                entries[n++] = Entry{&node, &node.first};
+            }
+        }
+        // Ordered maps of strings are sorted already
+        if (!std::is_sorted(entries, entries + n)) std::sort(entries, entries + n);
+
+        typename S::SerializeMap &state = TRY(serializer.serialize_map(ftl::Some(n)));
+        for (size_t i = 0; i < n; i++) {
+            TRY(state.serialize_key(entries[i].node->first));
+            TRY(state.serialize_value(entries[i].node->second));
+        }
+        return state.end_map();
+    }
+}
+
+namespace ser {
+    // Any range of key/value pairs
+    template<typename M, Serializer S>
+    ftl::Result<typename S::Ok, typename S::Error>
+    serialize_map_entries(const M &self, S &serializer) {
+        if constexpr (sorts_keys<S>) {
+            return detail::serialize_sorted_entries(self, serializer);
+        } else {
+            typename S::SerializeMap &state =
+                TRY(serializer.serialize_map(ftl::Some(self.size())));
+            for (auto &[key, value] : self) {
+                TRY(state.serialize_key(key));
+                TRY(state.serialize_value(value));
+            }
+            return state.end_map();
+        }
+    }
+    template<concepts::Serialize K, concepts::Serialize V, typename C, typename A>
+    struct Serialize<std::map<K, V, C, A>> {
+        template<Serializer S>
+        static ftl::Result<typename S::Ok, typename S::Error>
+        serialize(const std::map<K, V, C, A> &self, S &serializer) {
+            return serialize_map_entries(self, serializer);
+        }
+    };
+    template<concepts::Serialize K, concepts::Serialize V,
+             typename H, typename E, typename A>
+    struct Serialize<std::unordered_map<K, V, H, E, A>> {
+        template<Serializer S>
+        static ftl::Result<typename S::Ok, typename S::Error>
+        serialize(const std::unordered_map<K, V, H, E, A> &self, S &serializer) {
+            return serialize_map_entries(self, serializer);
+        }
+    };
+    template<concepts::Serialize K, concepts::Serialize V, typename C>
+    struct Serialize<FlatMap<K, V, C>> {
+        template<Serializer S>
+        static ftl::Result<typename S::Ok, typename S::Error>
+        serialize(const FlatMap<K, V, C> &self, S &serializer) {
+            return serialize_map_entries(self, serializer);
+        }
+    };
+
+    /**
+     * @brief   Serializer that writes a variant tag into the struct it is given
+     * @details Used for TagStyle::Internal: the tag becomes the first field of
+     *          the alternative's own struct or map. Alternatives that are not
+     *          structs or maps have nowhere to put the tag and fail.
+     */
+    template<Serializer S>
+    struct InternallyTagged {
+        using Ok = typename S::Ok;
+        using Error = typename S::Error;
+        using SerializeStruct = typename S::SerializeStruct;
+        using SerializeSeq = typename S::SerializeSeq;
+        using SerializeMap = typename S::SerializeMap;
+        using Result = ftl::Result<Ok, Error>;
+        // The fields still sort, the tag stays in front of them
+        static constexpr bool SORT_KEYS = sorts_keys<S>;
+
+        S &inner;
+        ftl::str tag;
+        ftl::str name;
+
+        static Error untaggable() {
+            return Error::custom("internally tagged variant must hold a struct or map");
+        }
+
+        Result serialize_unit() { return ftl::Err(untaggable()); }
+        Result serialize_bool(const bool &) { return ftl::Err(untaggable()); }
+        Result serialize_char(const char &) { return ftl::Err(untaggable()); }
+        Result serialize_schar(const signed char &) { return ftl::Err(untaggable()); }
+        Result serialize_short(const short &) { return ftl::Err(untaggable()); }
+        Result serialize_int(const int &) { return ftl::Err(untaggable()); }
+        Result serialize_long(const long &) { return ftl::Err(untaggable()); }
+        Result serialize_long_long(const long long &) { return ftl::Err(untaggable()); }
+        Result serialize_uchar(const unsigned char &) { return ftl::Err(untaggable()); }
+        Result serialize_ushort(const unsigned short &) { return ftl::Err(untaggable()); }
+        Result serialize_uint(const unsigned int &) { return ftl::Err(untaggable()); }
+        Result serialize_ulong(const unsigned long &) { return ftl::Err(untaggable()); }
+        Result serialize_ulong_long(const unsigned long long &) { return ftl::Err(untaggable()); }
+        Result serialize_float(const float &) { return ftl::Err(untaggable()); }
+        Result serialize_double(const double &) { return ftl::Err(untaggable()); }
+        Result serialize_str(const ftl::str &) { return ftl::Err(untaggable()); }
+        ftl::Result<SerializeSeq &, Error> serialize_seq(ftl::Option<size_t>) {
+            return ftl::Err(untaggable());
+        }
+
+        ftl::Result<SerializeStruct &, Error>
+        serialize_struct(const ftl::str &struct_name, const size_t len) {
+            SerializeStruct &state = TRY(inner.serialize_struct(struct_name, len + 1));
+            TRY(state.serialize_field(tag, name));
+            return ftl::Ok(std::ref(state));
+        }
+        ftl::Result<SerializeMap &, Error>
+        serialize_map(ftl::Option<size_t> len) {
+            SerializeMap &state = TRY(inner.serialize_map(
+                        len.is_some() ? ftl::Some(len.unwrap() + 1) : len));
+            TRY(state.serialize_key(tag));
+            TRY(state.serialize_value(name));
+            return ftl::Ok(std::ref(state));
+        }
+    };
+
+    /**
+     * @brief   std::variant, tagged as VariantRepr says
+     * @details std::visit already dispatches through a table of the
+     *          alternatives, so writing a tag costs one indirect call.
+     */
+    template<concepts::Serialize... Ts>
+    struct Serialize<std::variant<Ts...>> {
+        using Repr = VariantRepr<std::variant<Ts...>>;
+
+        template<Serializer S>
+        static ftl::Result<typename S::Ok, typename S::Error>
+        serialize(const std::variant<Ts...> &self, S &serializer) {
+            return std::visit([&](const auto &alt) {
+                return serialize_alternative(alt, serializer);
+            }, self);
+        }
+
+        template<typename T, Serializer S>
+        static ftl::Result<typename S::Ok, typename S::Error>
+        serialize_alternative(const T &alt, S &serializer) {
+            constexpr ftl::str name = detail::variant_name<T, Serialize<T>>();
+            if constexpr (Repr::style == TagStyle::External) {
+                typename S::SerializeMap &state = TRY(serializer.serialize_map(ftl::Some(size_t(1))));
+                TRY(state.serialize_key(name));
+                TRY(state.serialize_value(alt));
+                return state.end_map();
+            } else if constexpr (Repr::style == TagStyle::Adjacent) {
+                typename S::SerializeStruct &state = TRY(serializer.serialize_struct(name, 2));
+                TRY(state.serialize_field(Repr::tag, name));
+                TRY(state.serialize_field(Repr::content, alt));
+                return state.end();
+            } else {
+                InternallyTagged<S> tagged{serializer, Repr::tag, name};
+                return Serialize<T>::serialize(alt, tagged);
+            }
+        }
+    };
+
     template<concepts::Serialize T>
     struct Serialize<ftl::Option<T>> {
         template<Serializer S>
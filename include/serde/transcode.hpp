@@ -0,0 +1,209 @@
+#ifndef SERDE_TRANSCODE_H_
+#define SERDE_TRANSCODE_H_
+
+#include <concepts>
+#include <type_traits>
+#include <utility>
+
+#include <ftl.hpp>
+
+#include "serde/de.hpp"
+#include "serde/ser.hpp"
+
+namespace serde {
+namespace detail::transcode {
+    // Value the transcoding visitors produce, the output went to the serializer
+    struct Transcoded {};
+
+    /**
+     * @brief   Serializer errors met inside the deserializer's callbacks
+     * @details Visitors and seeds can only fail with the deserializer's
+     *          error, so a serializer error is parked here and replaced by
+     *          a marker until it is back on the serializer's side. Error
+     *          types only borrow their messages, converting through a
+     *          description would leave them dangling.
+     */
+    template<typename SE>
+    struct Stash {
+        ftl::Option<SE> error = ftl::Option<SE>(ftl::None());
+
+        template<typename DE>
+        DE park(SE err) {
+            error = ftl::Some(std::move(err));
+            return DE::custom("serializer error");
+        }
+        template<typename DE>
+        SE take(DE err) {
+            if (error.is_some()) {
+                SE res = std::move(error).unwrap();
+                error = ftl::Option<SE>(ftl::None());
+                return res;
+            }
+            return SE(std::move(err));
+        }
+    };
+
+    // Result of a serializer call, with its error parked
+    template<typename DE, typename SE, typename T>
+    ftl::Result<T, DE> park(Stash<SE> &stash, ftl::Result<T, SE> res) {
+        return std::move(res).map_err([&](SE err) {
+            return stash.template park<DE>(std::move(err));
+        });
+    }
+    // Same, for calls that only write
+    template<typename DE, typename SE>
+    ftl::Result<Transcoded, DE> forward(Stash<SE> &stash, ftl::Result<void, SE> res) {
+        TRY(park<DE>(stash, std::move(res)));
+        return ftl::Ok(Transcoded{});
+    }
+}
+
+namespace ser {
+    /**
+     * @brief   Serializable view of the next value of a Deserializer
+     * @details Serializing it deserializes the value with deserialize_any
+     *          and replays every event into the serializer, so the value is
+     *          never built in memory.
+     */
+    template<typename D, typename SE>
+    struct Transcoder {
+        D *deserializer;
+        detail::transcode::Stash<SE> *stash;
+    };
+}
+
+namespace de {
+    template<typename State, typename SE>
+    struct TranscodeElement { State *state; detail::transcode::Stash<SE> *stash; };
+    template<typename State, typename SE>
+    struct TranscodeKey { State *state; detail::transcode::Stash<SE> *stash; };
+    template<typename State, typename SE>
+    struct TranscodeValue { State *state; detail::transcode::Stash<SE> *stash; };
+
+    template<typename State, typename SE>
+    struct DeserializeSeed<TranscodeElement<State, SE>> {
+        using Value = detail::transcode::Transcoded;
+
+        template<typename D>
+        static ftl::Result<Value, typename D::Error>
+        deserialize(const TranscodeElement<State, SE> &self, D &deserializer) {
+            return detail::transcode::forward<typename D::Error>(*self.stash,
+                    self.state->serialize_element(ser::Transcoder<D, SE>{&deserializer, self.stash}));
+        }
+    };
+    template<typename State, typename SE>
+    struct DeserializeSeed<TranscodeKey<State, SE>> {
+        using Value = detail::transcode::Transcoded;
+
+        template<typename D>
+        static ftl::Result<Value, typename D::Error>
+        deserialize(const TranscodeKey<State, SE> &self, D &deserializer) {
+            return detail::transcode::forward<typename D::Error>(*self.stash,
+                    self.state->serialize_key(ser::Transcoder<D, SE>{&deserializer, self.stash}));
+        }
+    };
+    template<typename State, typename SE>
+    struct DeserializeSeed<TranscodeValue<State, SE>> {
+        using Value = detail::transcode::Transcoded;
+
+        template<typename D>
+        static ftl::Result<Value, typename D::Error>
+        deserialize(const TranscodeValue<State, SE> &self, D &deserializer) {
+            return detail::transcode::forward<typename D::Error>(*self.stash,
+                    self.state->serialize_value(ser::Transcoder<D, SE>{&deserializer, self.stash}));
+        }
+    };
+
+    // Replays whatever deserialize_any finds into S
+    template<typename S, typename E>
+    struct TranscodeVisitor {
+        using Value = detail::transcode::Transcoded;
+        using SE = typename S::Error;
+        using Result = ftl::Result<Value, E>;
+
+        S &serializer;
+        detail::transcode::Stash<SE> *stash;
+
+        Result forward(ftl::Result<void, SE> res) {
+            return detail::transcode::forward<E>(*stash, std::move(res));
+        }
+
+        Result visit_unit() { return forward(serializer.serialize_unit()); }
+        Result visit_bool(bool value) { return forward(serializer.serialize_bool(value)); }
+        Result visit_char(char value) { return forward(serializer.serialize_char(value)); }
+        Result visit_schar(signed char value) { return forward(serializer.serialize_schar(value)); }
+        Result visit_short(short value) { return forward(serializer.serialize_short(value)); }
+        Result visit_int(int value) { return forward(serializer.serialize_int(value)); }
+        Result visit_long(long value) { return forward(serializer.serialize_long(value)); }
+        Result visit_long_long(long long value) { return forward(serializer.serialize_long_long(value)); }
+        Result visit_uchar(unsigned char value) { return forward(serializer.serialize_uchar(value)); }
+        Result visit_ushort(unsigned short value) { return forward(serializer.serialize_ushort(value)); }
+        Result visit_uint(unsigned int value) { return forward(serializer.serialize_uint(value)); }
+        Result visit_ulong(unsigned long value) { return forward(serializer.serialize_ulong(value)); }
+        Result visit_ulong_long(unsigned long long value) { return forward(serializer.serialize_ulong_long(value)); }
+        Result visit_float(float value) { return forward(serializer.serialize_float(value)); }
+        Result visit_double(double value) { return forward(serializer.serialize_double(value)); }
+        Result visit_str(ftl::str value) { return forward(serializer.serialize_str(value)); }
+
+        template<typename A> // SeqAccess
+        Result visit_seq(A seq) {
+            using State = typename S::SerializeSeq;
+            State &state = TRY(detail::transcode::park<E>(*stash,
+                        serializer.serialize_seq(ftl::Option<size_t>(ftl::None()))));
+            while (TRY(seq.next_element_seed(TranscodeElement<State, SE>{&state, stash})).is_some()) {}
+            return forward(state.end_seq());
+        }
+        template<typename A> // MapAccess
+        Result visit_map(A map) {
+            using State = typename S::SerializeMap;
+            State &state = TRY(detail::transcode::park<E>(*stash,
+                        serializer.serialize_map(ftl::Option<size_t>(ftl::None()))));
+            while (TRY(map.next_key_seed(TranscodeKey<State, SE>{&state, stash})).is_some()) {
+                TRY(map.next_value_seed(TranscodeValue<State, SE>{&state, stash}));
+            }
+            return forward(state.end_map());
+        }
+    };
+}
+
+namespace ser {
+    template<typename D, typename SE>
+    struct Serialize<Transcoder<D, SE>> {
+        template<Serializer S>
+        static ftl::Result<typename S::Ok, typename S::Error>
+        serialize(const Transcoder<D, SE> &self, S &serializer) {
+            static_assert(std::is_same_v<typename S::Error, SE>,
+                    "nested serializers must share the error type");
+            static_assert(std::is_void_v<typename S::Ok>,
+                    "transcoding needs a serializer that writes as it goes");
+            auto res = self.deserializer->deserialize_any(
+                    de::TranscodeVisitor<S, typename D::Error>{serializer, self.stash});
+            TRY(std::move(res).map_err([&](typename D::Error err) {
+                return self.stash->take(std::move(err));
+            }));
+            return ftl::Ok();
+        }
+    };
+}
+
+    /**
+     * @brief   Streams the next value of deserializer into serializer
+     * @details Works on any data, without a schema: scalars are passed on
+     *          as they are read, sequences and maps are opened, filled one
+     *          entry at a time and closed. Nothing is kept but the stack of
+     *          open containers, so memory does not grow with the input.
+     *          The serializer's Error has to be constructible from the
+     *          deserializer's; it is the same type when both ends are of
+     *          one format.
+     */
+    template<typename D, ser::Serializer S>
+    requires std::constructible_from<typename S::Error, typename D::Error>
+    ftl::Result<typename S::Ok, typename S::Error>
+    transcode(D &deserializer, S &serializer) {
+        detail::transcode::Stash<typename S::Error> stash;
+        return ser::Serialize<ser::Transcoder<D, typename S::Error>>::serialize(
+                ser::Transcoder<D, typename S::Error>{&deserializer, &stash}, serializer);
+    }
+}
+
+#endif // !SERDE_TRANSCODE_H_
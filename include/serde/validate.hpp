@@ -0,0 +1,202 @@
+#ifndef SERDE_VALIDATE_H_
+#define SERDE_VALIDATE_H_
+
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <ftl.hpp>
+
+#include "serde/de.hpp"
+#include "serde/fields.hpp"
+#include "serde/flat_map.hpp"
+
+namespace serde::de {
+    // Value of a successful validation, there is nothing to keep
+    struct Validated {};
+
+    /**
+     * @brief   Checks that the input would deserialize as T without building a T
+     * @details The default decodes a T and drops it, which is what scalars
+     *          and borrowed strings cost anyway. Derived structs, sequences
+     *          and maps are walked with the same key lookup and the same
+     *          missing/duplicate field rules as Deserialize<T>, but hold
+     *          no values, so validating them does not allocate.
+     */
+    template<typename T>
+    struct Validate {
+        template<concepts::Deserializer D>
+        static ftl::Result<Validated, typename D::Error>
+        validate(D &deserializer) {
+            TRY(Deserialize<T>::deserialize(deserializer));
+            return ftl::Ok(Validated{});
+        }
+    };
+
+    template<typename T>
+    struct ValidateSeed {};
+    template<typename T>
+    struct DeserializeSeed<ValidateSeed<T>> {
+        using Value = Validated;
+
+        template<typename D>
+        static ftl::Result<Validated, typename D::Error>
+        deserialize(const ValidateSeed<T> &self, D &deserializer) {
+            (void)self;
+            return Validate<T>::validate(deserializer);
+        }
+    };
+
+    template<>
+    struct Validate<std::string> : Validate<ftl::str> {};
+
+    template<typename T>
+    struct Validate<ftl::Option<T>> {
+        template<concepts::Deserializer D>
+        static ftl::Result<Validated, typename D::Error>
+        validate(D &deserializer) {
+            struct OptionVisitor {
+                using Value = Validated;
+                ftl::Result<Value, typename D::Error> visit_none() {
+                    return ftl::Ok(Validated{});
+                }
+                ftl::Result<Value, typename D::Error> visit_some(D &deserializer) {
+                    return Validate<T>::validate(deserializer);
+                }
+            };
+            return deserializer.deserialize_option(OptionVisitor{});
+        }
+    };
+    template<typename T>
+    struct Validate<std::vector<T>> {
+        template<concepts::Deserializer D>
+        static ftl::Result<Validated, typename D::Error>
+        validate(D &deserializer) {
+            return deserializer.deserialize_seq(Visitor{});
+        }
+        struct Visitor {
+            using Value = Validated;
+            template<typename A> // SeqAccess
+            ftl::Result<Value, typename A::Error>
+            visit_seq(A seq) {
+                while (TRY(seq.next_element_seed(ValidateSeed<T>{})).is_some()) {}
+                return ftl::Ok(Validated{});
+            }
+        };
+    };
+    template<typename T, size_t N>
+    struct Validate<std::array<T, N>> {
+        template<concepts::Deserializer D>
+        static ftl::Result<Validated, typename D::Error>
+        validate(D &deserializer) {
+            return deserializer.deserialize_seq(Visitor{});
+        }
+        struct Visitor {
+            using Value = Validated;
+            template<typename A> // SeqAccess
+            ftl::Result<Value, typename A::Error>
+            visit_seq(A seq) {
+                for (size_t i = 0; i < N; i++) {
+                    if (TRY(seq.next_element_seed(ValidateSeed<T>{})).is_none()) {
+                        return ftl::Err(A::Error::invalid_length(i));
+                    }
+                }
+                if (TRY(seq.next_element_seed(ValidateSeed<T>{})).is_some()) {
+                    return ftl::Err(A::Error::invalid_length(N + 1));
+                }
+                return ftl::Ok(Validated{});
+            }
+        };
+    };
+
+    template<typename K, typename V>
+    struct ValidateMap {
+        template<concepts::Deserializer D>
+        static ftl::Result<Validated, typename D::Error>
+        validate(D &deserializer) {
+            return deserializer.deserialize_map(Visitor{});
+        }
+        struct Visitor {
+            using Value = Validated;
+            template<typename A> // MapAccess
+            ftl::Result<Value, typename A::Error>
+            visit_map(A map) {
+                while (TRY(map.next_key_seed(ValidateSeed<K>{})).is_some()) {
+                    TRY(map.next_value_seed(ValidateSeed<V>{}));
+                }
+                return ftl::Ok(Validated{});
+            }
+        };
+    };
+    template<typename K, typename V, typename C, typename A>
+    struct Validate<std::map<K, V, C, A>> : ValidateMap<K, V> {};
+    template<typename K, typename V, typename H, typename E, typename A>
+    struct Validate<std::unordered_map<K, V, H, E, A>> : ValidateMap<K, V> {};
+    template<typename K, typename V, typename C>
+    struct Validate<FlatMap<K, V, C>> : ValidateMap<K, V> {};
+
+    template<typename L>
+    struct ValidateFields;
+
+    // Presence of each field is one bit instead of an Option holding it
+    template<typename T, typename... Fs>
+    struct ValidateFields<Fields<T, Fs...>> {
+        using L = Fields<T, Fs...>;
+
+        template<size_t I, typename A>
+        static ftl::Result<Validated, typename A::Error> validate_field(A &map) {
+            using Type = std::tuple_element_t<I, std::tuple<std::remove_cv_t<typename Fs::Type>...>>;
+            return map.next_value_seed(ValidateSeed<Type>{});
+        }
+        template<typename A>
+        using ValidateField = ftl::Result<Validated, typename A::Error> (*)(A &);
+        template<typename A, size_t... Is>
+        static constexpr std::array<ValidateField<A>, sizeof...(Fs)>
+        validate_table(std::index_sequence<Is...>) {
+            return { &validate_field<Is, A>... };
+        }
+        template<typename A>
+        static constexpr auto VALIDATE_TABLE = validate_table<A>(std::index_sequence_for<Fs...>{});
+
+        template<concepts::Deserializer D>
+        static ftl::Result<Validated, typename D::Error>
+        validate(D &deserializer) {
+            return deserializer.deserialize_struct(
+                    &*Deserialize<T>::NAME.begin(), L::NAMES, Visitor{});
+        }
+        struct Visitor {
+            using Value = Validated;
+            template<typename A> // MapAccess
+            ftl::Result<Value, typename A::Error> visit_map(A map) {
+                std::bitset<L::COUNT> seen;
+                size_t hint = 0;
+                for (auto index = TRY(map.next_key_seed(FieldSeed<L>{hint}));
+                        index.is_some();
+                        index = TRY(map.next_key_seed(FieldSeed<L>{hint}))) {
+                    size_t i = index.unwrap();
+                    if (seen[i]) return ftl::Err(A::Error::duplicate_field(L::NAMES[i]));
+                    seen.set(i);
+                    TRY(VALIDATE_TABLE<A>[i](map));
+                    hint = i + 1;
+                }
+                if (!seen.all()) {
+                    for (size_t i = 0; i < L::COUNT; i++) {
+                        if (!seen[i] && !L::DEFAULTED[i]) {
+                            return ftl::Err(A::Error::missing_field(L::NAMES[i]));
+                        }
+                    }
+                }
+                return ftl::Ok(Validated{});
+            }
+        };
+    };
+    template<typename T>
+    requires requires { typename Deserialize<T>::Fields; }
+    struct Validate<T> : ValidateFields<typename Deserialize<T>::Fields> {};
+}
+
+#endif // !SERDE_VALIDATE_H_
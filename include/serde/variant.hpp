@@ -0,0 +1,63 @@
+#ifndef SERDE_VARIANT_H_
+#define SERDE_VARIANT_H_
+
+#include <cstring>
+
+#include <ftl.hpp>
+
+namespace serde {
+    enum class TagStyle {
+        // {"Name": {...}}
+        External,
+        // {"type": "Name", ...}, the alternatives must be structs
+        Internal,
+        // {"type": "Name", "content": {...}}
+        Adjacent,
+    };
+
+    /**
+     * @brief   How a std::variant is tagged
+     * @details Specialize for a variant type to change its encoding:
+     *
+     *          template<>
+     *          struct serde::VariantRepr<Event> {
+     *              static constexpr TagStyle style = TagStyle::Internal;
+     *              static constexpr ftl::str tag = "kind";
+     *              static constexpr ftl::str content = "content";
+     *          };
+     */
+    template<typename V>
+    struct VariantRepr {
+        static constexpr TagStyle style = TagStyle::External;
+        static constexpr ftl::str tag = "type";
+        static constexpr ftl::str content = "content";
+    };
+
+    /**
+     * @brief   Name of a variant alternative
+     * @details Defaults to the NAME of the derived Serialize/Deserialize.
+     *          Specialize with a `static constexpr ftl::str value` to rename
+     *          an alternative or to name one that is not derived.
+     */
+    template<typename T>
+    struct VariantName {};
+
+    namespace detail {
+        // Impl is the Serialize or Deserialize specialization of T
+        template<typename T, typename Impl>
+        constexpr ftl::str variant_name() {
+            if constexpr (requires { VariantName<T>::value; }) {
+                return VariantName<T>::value;
+            } else {
+                return Impl::NAME;
+            }
+        }
+
+        inline bool name_eq(const ftl::str &a, const ftl::str &b) {
+            return a.len() == b.len()
+                && (a.len() == 0 || memcmp(&*a.begin(), &*b.begin(), a.len()) == 0);
+        }
+    }
+}
+
+#endif // !SERDE_VARIANT_H_
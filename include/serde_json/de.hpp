@@ -1,141 +1,576 @@
+#ifndef JSON_DE_H_
+#define JSON_DE_H_
+
+#include <algorithm>
+#include <charconv>
 #include <concepts>
 #include <cstring>
+#include <deque>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <utility>
 
 #include "serde/de.hpp"
 #include "fst/fst.hpp"
 #include "serde_json/error.hpp"
+#include "serde_json/fwd.hpp"
+#include "serde_json/instrument.hpp"
+#include "serde_json/utf8.hpp"
 
 #include <ftl.hpp>
 
 namespace serde_json::de {
     using error::Result;
 
+    /**
+     * @brief   JSON Deserializer
+     * @details Scanning works on the raw input pointer. A primitive that fails
+     *          records its error in the sticky error slot and returns a dummy
+     *          value, so the scanning code has no Result to build or unwrap
+     *          for each byte. The slot is checked, and turned into a Result,
+     *          only where a value is handed to a visitor.
+     *          The slot is just a code and a position: keeping a whole Error
+     *          in here stops the compiler from keeping the cursor in a
+     *          register, which costs more than everything else combined.
+     *          The input is [start, end) and needs no NUL terminator: peek()
+     *          reads '\0' at the end, so the scanning code ends up in its
+     *          Eof branch for both. Number scans only check for the end when
+     *          the input stops in the middle of a number, anywhere else a
+     *          run of digits is guaranteed to hit another byte first.
+     */
     struct Deserializer {
         using Error = error::Error;
+        const char *start;
         const char *input;
-        Deserializer(const char *in) : input(in) {};
+        const char *end;
+        // The last byte of the input could belong to a number
+        bool number_at_end;
+        // Sticky error slot
+        const char *err_pos = nullptr;
+        Error::Tag err_code;
+        // Key the next object has to skip, see deserialize_internally_tagged
+        const ftl::str *tag_key = nullptr;
+        // Containers that may still be opened, lower it before parsing to
+        // accept less nesting. Every level costs a few stack frames.
+        static constexpr size_t DEFAULT_DEPTH_LIMIT = 128;
+        size_t remaining_depth = DEFAULT_DEPTH_LIMIT;
+        // Closer stack of skip_value, kept by the owner to reuse its capacity
+        std::string *scratch = nullptr;
+        // What to do with strings that are not UTF-8. Replace copies them
+        // into repaired, which has to outlive the decoded value, and
+        // without it works like Strict.
+        utf8::Mode utf8_mode = utf8::Mode::Strict;
+        std::deque<std::string> *repaired = nullptr;
+        // Closing brace of the last object count_entries scanned in full
+        const char *counted_end = nullptr;
+        // The terminator stops every scan, whatever the input ends with
+        Deserializer(const char *in)
+            : start(in), input(in), end(in + strlen(in)), number_at_end(false) {}
+        Deserializer(const char *in, size_t len)
+            : start(in), input(in), end(in + len),
+              number_at_end(len != 0 && is_number_char(in[len - 1])) {}
+
+        static bool is_number_char(char ch) {
+            return ch != '\0' && memchr("0123456789+-.eE", ch, 15) != nullptr;
+        }
+
+        // Errors
+        Error error(Error err) const {
+            return err.at(this->start, this->input);
+        }
+        template<typename T>
+        Result<T> fix_position(Result<T> res) const {
+            return std::move(res).map_err([this](Error err) {
+                return this->error(err);
+            });
+        }
+        bool failed() const {
+            return this->err_pos != nullptr;
+        }
+        // Records the first error only, later ones are fallout from it
+        void fail(Error::Tag code) {
+            if (this->failed()) return;
+            this->err_code = code;
+            this->err_pos = this->input;
+        }
+        [[gnu::cold, gnu::noinline]] Error take_error() const {
+            return Error::code(this->err_code).at(this->start, this->err_pos);
+        }
 
         // Parsing
-        Result<char> peek_char() {
-            if (*this->input == '\0') {
-                return ftl::Err(Error::Eof());
+        char peek() const {
+            return this->input != this->end ? *this->input : '\0';
+        }
+        // Consumes ch, otherwise fails with code (Eof at the end of input)
+        bool eat(char ch, Error::Tag code) {
+            if (this->peek() == ch) {
+                this->input++;
+                return true;
+            }
+            this->fail(this->peek() == '\0' ? Error::Tag::Eof : code);
+            return false;
+        }
+        // Consumes the keyword lit if the input continues with it
+        template<size_t N>
+        bool eat_literal(const char (&lit)[N]) {
+            if ((size_t)(this->end - this->input) >= N - 1
+                    && memcmp(this->input, lit, N - 1) == 0) {
+                this->input += N - 1;
+                return true;
+            }
+            return false;
+        }
+        bool parse_bool() {
+            if (this->eat_literal("true")) {
+                return true;
+            } else if (this->eat_literal("false")) {
+                return false;
+            }
+            this->fail(Error::Tag::ExpectedBoolean);
+            return false;
+        }
+        /**
+         * @brief   Unsigned T at the cursor, at most limit
+         * @details The loop is instantiated for each width and has no range
+         *          check: a number of at most SAFE digits can not go past
+         *          limit. Only longer ones, rare in practice, are parsed
+         *          again with the check. Out of range fails at the first
+         *          digit. A limit below the maximum of T needs the digits10
+         *          of that limit's type as SAFE.
+         */
+        template<typename T, int SAFE = std::numeric_limits<T>::digits10>
+        T parse_unsigned(T limit = std::numeric_limits<T>::max()) {
+            static_assert(std::is_unsigned_v<T>);
+            const char *p = this->input;
+            if ((unsigned char)(this->peek() - '0') > 9) {
+                this->fail(this->peek() == '\0' ? Error::Tag::Eof : Error::Tag::ExpectedInteger);
+                return 0;
+            }
+            T res = 0;
+            if (this->number_at_end) {
+                do {
+                    res = res * 10 + (*p++ - '0');
+                } while (p != this->end && (unsigned char)(*p - '0') <= 9);
             } else {
-                return ftl::Ok(*this->input);
+                do {
+                    res = res * 10 + (*p++ - '0');
+                } while ((unsigned char)(*p - '0') <= 9);
+            }
+            if (p - this->input > SAFE) {
+                return this->parse_unsigned_checked<T>(p, limit);
+            }
+            this->input = p;
+            return res;
+        }
+        template<typename T>
+        [[gnu::cold, gnu::noinline]] T parse_unsigned_checked(const char *stop, T limit) {
+            T res = 0;
+            for (const char *p = this->input; p != stop; p++) {
+                unsigned digit = *p - '0';
+                if (digit > limit || res > (T)(limit - digit) / 10) {
+                    this->fail(Error::Tag::NumberOutOfRange);
+                    return 0;
+                }
+                res = res * 10 + digit;
             }
+            this->input = stop;
+            return res;
+        }
+        // Signed T at the cursor, the magnitude is parsed as unsigned
+        template<typename T>
+        T parse_signed() {
+            using U = std::make_unsigned_t<T>;
+            bool neg = this->peek() == '-';
+            this->input += neg;
+            U max = (U)std::numeric_limits<T>::max();
+            // 19 digits fit an unsigned long long, not every one fits a long long
+            U res = this->parse_unsigned<U, std::numeric_limits<T>::digits10>(
+                    neg ? (U)(max + 1) : max);
+            return neg ? (T)(U)(0 - res) : (T)res;
         }
-        Result<char> next_char() {
-            char ch = TRY(this->peek_char());
-            this->input++;
-            return ftl::Ok(ch);
+        void parse_null() {
+            if (!this->eat_literal("null")) this->fail(Error::Tag::ExpectedNull);
         }
-        Result<bool> parse_bool() {
-            if (strncmp(this->input, "true", 4) == 0) {
-                this->input += strlen("true");
-                return ftl::Ok(true);
-            } else if (strncmp(this->input, "false", 5) == 0) {
-                return ftl::Ok(false);
+        // End of the number at the cursor, checked by whoever parses it
+        const char *number_end() const {
+            const char *p = this->input;
+            if (this->number_at_end) {
+                while (p != this->end && is_number_char(*p)) p++;
+            } else {
+                while (is_number_char(*p)) p++;
             }
-            return ftl::Err(Error(Error::ExpectedBoolean()));
+            return p;
         }
+        // Parsed straight into T, a float is not rounded twice
         template<typename T>
-        Result<T> parse_unsigned() {
-            char ch = TRY(this->next_char());
-            if (ch < '0' || ch > '9')
-                return ftl::Err(Error::ExpectedInteger());
-            T res = ch - '0';
-            while (true) {
-                // TODO: refactor this and remove the stupid macros
-                switch (auto ___self = this->peek_char(); ___self.tag) {
-                case decltype(___self)::Tag ::Ok: {
-                    auto ch = ___self.unwrap();
-                    if (!(ch >= '0' && ch <= '9')) goto ___default;
-                    {
+        T parse_floating() {
+            const char *stop = this->number_end();
+            T res = 0;
+            auto [ptr, ec] = std::from_chars(this->input, stop, res);
+            if (ptr == stop && ec == std::errc::result_out_of_range) {
+                this->fail(Error::Tag::NumberOutOfRange);
+                return 0;
+            }
+            if (ec != std::errc() || ptr != stop) {
+                this->fail(this->peek() == '\0' ? Error::Tag::Eof : Error::Tag::ExpectedNumber);
+                return 0;
+            }
+            this->input = stop;
+            return res;
+        }
+        double parse_double() {
+            return this->parse_floating<double>();
+        }
+        ftl::str parse_string() {
+            if (!this->eat('"', Error::Tag::ExpectedString)) return ftl::str();
+            bool ascii = true;
+            const char *quote = this->utf8_mode == utf8::Mode::Off
+                ? (const char *)memchr(this->input, '"', this->end - this->input)
+                : utf8::find_quote(this->input, this->end, &ascii);
+            if (quote == nullptr) {
+                this->input = this->end;
+                this->fail(Error::Tag::Eof);
+                return ftl::str();
+            }
+            // Returned raw like any other, the count says how often that matters
+            SERDE_JSON_COUNT(escaped_strings,
+                    memchr(this->input, '\\', quote - this->input) != nullptr);
+            if (!ascii && !utf8::valid(this->input, quote - this->input)) {
+                return this->invalid_utf8(quote);
+            }
+            ftl::str res(this->input, quote - this->input);
+            this->input = quote + 1;
+            return res;
+        }
+        // String up to quote, at the cursor, that is not well-formed UTF-8
+        [[gnu::cold, gnu::noinline]] ftl::str invalid_utf8(const char *quote) {
+            size_t len = quote - this->input;
+            if (this->utf8_mode == utf8::Mode::Replace && this->repaired != nullptr) {
+                std::string &fixed = this->repaired->emplace_back();
+                utf8::append_replaced(this->input, len, fixed);
+                this->input = quote + 1;
+                return ftl::str(fixed.data(), fixed.size());
+            }
+            this->input += utf8::first_invalid_scalar(this->input, len);
+            this->fail(Error::Tag::InvalidUtf8);
+            return ftl::str();
+        }
+        /**
+         * @brief   Steps over one value of any type
+         * @details Iterative: open containers are kept as a string of their
+         *          closing brackets instead of as stack frames, so skipping
+         *          does not grow the stack with the nesting. The depth limit
+         *          still applies.
+         */
+        void skip_value() {
+            std::string local;
+            std::string &open = this->scratch != nullptr ? *this->scratch : local;
+            open.clear();
+            for (;;) {
+                switch (this->peek()) {
+                case '[':
+                case '{': {
+                    if (open.size() == this->remaining_depth) {
+                        this->fail(Error::Tag::RecursionLimitExceeded);
+                        return;
+                    }
+                    char close = this->peek() == '[' ? ']' : '}';
+                    this->input++;
+                    if (this->peek() == close) {
                         this->input++;
-                        res *= 10;
-                        res += ch - '0';
+                        break;
                     }
+                    open += close;
+                    if (close == '}' && !this->skip_key()) return;
+                    continue;
+                }
+                case '"':
+                    this->parse_string();
+                    break;
+                case 't':
+                case 'f':
+                    this->parse_bool();
+                    break;
+                case 'n':
+                    this->parse_null();
+                    break;
+                case '-':
+                case '0' ... '9':
+                    this->input = this->number_end();
                     break;
+                case '\0':
+                    this->fail(Error::Tag::Eof);
+                    return;
+                default:
+                    this->fail(Error::Tag::Syntax);
+                    return;
                 }
-                default: {
-                    ___default : { return ftl::Ok(res); }
+                if (this->failed()) return;
+                // A value ended, close what it ended or go to the next entry
+                for (;;) {
+                    if (open.empty()) return;
+                    char close = open.back();
+                    if (this->peek() == close) {
+                        this->input++;
+                        open.pop_back();
+                        continue;
+                    }
+                    Error::Tag comma = close == ']'
+                        ? Error::Tag::ExpectedArrayComma
+                        : Error::Tag::ExpectedMapComma;
+                    if (!this->eat(',', comma)) return;
+                    if (close == '}' && !this->skip_key()) return;
+                    break;
                 }
+            }
+        }
+        // Steps over `"key":`
+        bool skip_key() {
+            this->parse_string();
+            return !this->failed() && this->eat(':', Error::Tag::ExpectedMapColon);
+        }
+        /**
+         * @brief   Entries of the object the cursor is in, from the cursor on
+         * @details Counts the commas outside nested containers and strings
+         *          up to the closing brace, without decoding anything, so a
+         *          map can be reserved before it is filled. Malformed input
+         *          only gives a wrong count, the decoder reports the error.
+         *          An object inside one that was counted scans bytes that were
+         *          scanned already, so its scan gives up after COUNT_LIMIT
+         *          bytes: a deeply nested document costs at most that much
+         *          per level on top of one pass, instead of its whole size.
+         */
+        static constexpr size_t COUNT_LIMIT = 4096;
+        ftl::Option<size_t> count_entries() {
+            size_t depth = 0;
+            size_t commas = 0;
+            bool nested = this->input < this->counted_end;
+            const char *stop = nested && (size_t)(this->end - this->input) > COUNT_LIMIT
+                ? this->input + COUNT_LIMIT : this->end;
+            for (const char *p = this->input; p < stop; p++) {
+                switch (*p) {
+                case '"':
+                    p = (const char *)memchr(p + 1, '"', stop - p - 1);
+                    if (p == nullptr) return this->count_cut(stop, commas);
+                    break;
+                case '[':
+                case '{':
+                    depth++;
+                    break;
+                case ']':
+                case '}':
+                    if (depth == 0) {
+                        if (!nested) this->counted_end = p;
+                        return ftl::Some(p == this->input ? 0 : commas + 1);
+                    }
+                    depth--;
+                    break;
+                case ',':
+                    commas += depth == 0;
+                    break;
                 }
             }
+            return this->count_cut(stop, commas);
         }
-        template<typename T>
-        Result<T> parse_signed() {
-            bool neg = TRY(this->peek_char()) == '-';
-            if (neg) this->input++;
-            T res = TRY(this->parse_unsigned<T>());
-            return ftl::Ok(neg ? -res : res);
+        // No hint when the limit cut the scan short, the input ending is the map's end
+        ftl::Option<size_t> count_cut(const char *stop, size_t commas) const {
+            if (stop != this->end) return ftl::None();
+            return ftl::Some(commas + 1);
         }
-        Result<ftl::str> parse_string() {
-            if (TRY(this->next_char()) != '"') return ftl::Err(Error::ExpectedString());
-            const char *end = strchr(this->input, '"');
-            if (end == NULL) return ftl::Err(Error::Eof());
-            ftl::str res(this->input, end - this->input);
-            this->input = end + 1;
-            return ftl::Ok(res);
+        /**
+         * @brief   One level of nesting, taken from remaining_depth while alive
+         * @details Check ok() right after constructing it: at the limit the
+         *          level is not taken and the error is recorded instead.
+         */
+        struct Nested {
+            Deserializer &de;
+            bool entered;
+            Nested(Deserializer &de) : de(de), entered(de.remaining_depth != 0) {
+                if (entered) {
+                    de.remaining_depth--;
+                } else {
+                    de.fail(Error::Tag::RecursionLimitExceeded);
+                }
+            }
+            ~Nested() {
+                if (entered) de.remaining_depth++;
+            }
+            bool ok() const { return entered; }
+        };
+        // Scans the object at the cursor for the string value of key,
+        // leaves the cursor somewhere inside the object
+        bool find_tag(const ftl::str &key, ftl::str &value) {
+            if (!this->eat('{', Error::Tag::ExpectedMap)) return false;
+            for (bool first = true; this->peek() != '}'; first = false) {
+                if (!first && !this->eat(',', Error::Tag::ExpectedMapComma)) return false;
+                ftl::str entry = this->parse_string();
+                if (this->failed() || !this->eat(':', Error::Tag::ExpectedMapColon)) return false;
+                if (serde::detail::name_eq(entry, key)) {
+                    value = this->parse_string();
+                    return !this->failed();
+                }
+                this->skip_value();
+                if (this->failed()) return false;
+            }
+            return false;
+        }
+        // Consumes `"key":` if the entry at the cursor has that key
+        bool eat_key(const ftl::str &key) {
+            const char *entry = this->input;
+            ftl::str name = this->parse_string();
+            if (this->failed() || !serde::detail::name_eq(name, key)) {
+                this->input = entry;
+                return false;
+            }
+            this->eat(':', Error::Tag::ExpectedMapColon);
+            return true;
+        }
+        // Steps over the entry at the cursor if its key is key
+        bool skip_entry(const ftl::str &key) {
+            if (!this->eat_key(key)) return false;
+            if (!this->failed()) this->skip_value();
+            return true;
         }
 
         // Deserializer trait
         template<typename V>
         Result<typename V::Value> deserialize_any(V visitor) {
-            switch (TRY(this->peek_char())) {
+            switch (this->peek()) {
             case 't':
             case 'f':
-                this->deserialize_bool(visitor);
-                break;
+                return this->deserialize_bool(visitor);
             case '"':
-                this->deserialize_str(visitor);
-                break;
-            case '0' ... '9':
-                this->deserialize_ulong_long(visitor);
-                break;
+                return this->deserialize_str(visitor);
+            case 'n': {
+                this->parse_null();
+                if (this->failed()) return ftl::Err(this->take_error());
+                return this->fix_position(visitor.visit_unit());
+            }
+            case '[':
+                return this->deserialize_seq(visitor);
+            case '{':
+                return this->deserialize_map(visitor);
             case '-':
-                this->deserialize_long_long(visitor);
-                break;
+            case '0' ... '9': {
+                const char *end = this->number_end();
+                if (std::find_if(this->input, end, [](char c) {
+                        return c == '.' || c == 'e' || c == 'E';
+                    }) != end) {
+                    double value = this->parse_double();
+                    if (this->failed()) return ftl::Err(this->take_error());
+                    return this->fix_position(visitor.visit_double(value));
+                }
+                if (this->peek() == '-') return this->deserialize_long_long(visitor);
+                return this->deserialize_ulong_long(visitor);
+            }
+            case '\0':
+                return ftl::Err(this->error(Error::Eof()));
+            default:
+                return ftl::Err(this->error(Error::Syntax()));
             }
         }
+        // null is None, anything else is the Some value
+        template<typename V>
+        Result<typename V::Value> deserialize_option(V visitor) {
+            if (this->peek() == 'n') {
+                this->parse_null();
+                if (this->failed()) return ftl::Err(this->take_error());
+                return this->fix_position(visitor.visit_none());
+            }
+            return visitor.visit_some(*this);
+        }
         template<typename V>
         Result<typename V::Value> deserialize_bool(V visitor) {
-            return visitor.visit_bool(TRY(parse_bool()));
+            bool value = this->parse_bool();
+            if (this->failed()) return ftl::Err(this->take_error());
+            return this->fix_position(visitor.visit_bool(value));
+        }
+        // A one byte string, what Serializer::serialize_char writes
+        template<typename V>
+        Result<typename V::Value> deserialize_char(V visitor) {
+            ftl::str value = this->parse_string();
+            if (this->failed()) return ftl::Err(this->take_error());
+            if (value.len() != 1) return ftl::Err(this->error(Error::invalid_length(value.len())));
+            return this->fix_position(visitor.visit_char(*value.begin()));
+        }
+        template<typename V>
+        Result<typename V::Value> deserialize_schar(V visitor) {
+            signed char value = this->parse_signed<signed char>();
+            if (this->failed()) return ftl::Err(this->take_error());
+            return this->fix_position(visitor.visit_schar(value));
         }
         template<typename V>
         Result<typename V::Value> deserialize_short(V visitor) {
-            return visitor.visit_short(TRY(parse_signed<short>()));
+            short value = this->parse_signed<short>();
+            if (this->failed()) return ftl::Err(this->take_error());
+            return this->fix_position(visitor.visit_short(value));
         }
         template<typename V>
         Result<typename V::Value> deserialize_int(V visitor) {
-            return visitor.visit_int(TRY(parse_signed<int>()));
+            int value = this->parse_signed<int>();
+            if (this->failed()) return ftl::Err(this->take_error());
+            return this->fix_position(visitor.visit_int(value));
         }
         template<typename V>
         Result<typename V::Value> deserialize_long(V visitor) {
-            return visitor.visit_long(TRY(parse_signed<long>()));
+            long value = this->parse_signed<long>();
+            if (this->failed()) return ftl::Err(this->take_error());
+            return this->fix_position(visitor.visit_long(value));
         }
         template<typename V>
         Result<typename V::Value> deserialize_long_long(V visitor) {
-            return visitor.visit_long_long(TRY(parse_signed<long long>()));
+            long long value = this->parse_signed<long long>();
+            if (this->failed()) return ftl::Err(this->take_error());
+            return this->fix_position(visitor.visit_long_long(value));
+        }
+        template<typename V>
+        Result<typename V::Value> deserialize_uchar(V visitor) {
+            unsigned char value = this->parse_unsigned<unsigned char>();
+            if (this->failed()) return ftl::Err(this->take_error());
+            return this->fix_position(visitor.visit_uchar(value));
         }
         template<typename V>
         Result<typename V::Value> deserialize_ushort(V visitor) {
-            return visitor.visit_short(TRY(parse_unsigned<unsigned short>()));
+            unsigned short value = this->parse_unsigned<unsigned short>();
+            if (this->failed()) return ftl::Err(this->take_error());
+            return this->fix_position(visitor.visit_ushort(value));
         }
         template<typename V>
         Result<typename V::Value> deserialize_uint(V visitor) {
-            return visitor.visit_int(TRY(parse_unsigned<unsigned int>()));
+            unsigned int value = this->parse_unsigned<unsigned int>();
+            if (this->failed()) return ftl::Err(this->take_error());
+            return this->fix_position(visitor.visit_uint(value));
         }
         template<typename V>
         Result<typename V::Value> deserialize_ulong(V visitor) {
-            return visitor.visit_long(TRY(parse_unsigned<unsigned long>()));
+            unsigned long value = this->parse_unsigned<unsigned long>();
+            if (this->failed()) return ftl::Err(this->take_error());
+            return this->fix_position(visitor.visit_ulong(value));
         }
         template<typename V>
         Result<typename V::Value> deserialize_ulong_long(V visitor) {
-            return visitor.visit_long_long(TRY(parse_unsigned<unsigned long long>()));
+            unsigned long long value = this->parse_unsigned<unsigned long long>();
+            if (this->failed()) return ftl::Err(this->take_error());
+            return this->fix_position(visitor.visit_ulong_long(value));
+        }
+        template<typename V>
+        Result<typename V::Value> deserialize_float(V visitor) {
+            float value = this->parse_floating<float>();
+            if (this->failed()) return ftl::Err(this->take_error());
+            return this->fix_position(visitor.visit_float(value));
+        }
+        template<typename V>
+        Result<typename V::Value> deserialize_double(V visitor) {
+            double value = this->parse_floating<double>();
+            if (this->failed()) return ftl::Err(this->take_error());
+            return this->fix_position(visitor.visit_double(value));
         }
         template<typename V>
         Result<typename V::Value> deserialize_str(V visitor) {
-            return visitor.visit_str(TRY(parse_string()));
+            ftl::str value = this->parse_string();
+            if (this->failed()) return ftl::Err(this->take_error());
+            return this->fix_position(visitor.visit_str(value));
         }
         template<typename V>
         Result<typename V::Value> deserialize_identifier(V visitor) {
@@ -143,29 +578,24 @@ namespace serde_json::de {
         }
         template<typename V>
         Result<typename V::Value> deserialize_seq(V visitor) {
-            if (TRY(next_char()) == '[') {
-                auto value = TRY(visitor.visit_seq(CommaSeparated(*this)));
-                if (TRY(next_char()) == ']') {
-                    return ftl::Ok(value);
-                } else {
-                    return ftl::Err(Error::ExpectedArrayEnd());
-                }
-            } else {
-                return ftl::Err(Error::ExpectedArray());
-            }
+            SERDE_JSON_COUNT(seqs[instrument::De]);
+            Nested nested(*this);
+            if (!nested.ok()) return ftl::Err(this->take_error());
+            if (!this->eat('[', Error::Tag::ExpectedArray)) return ftl::Err(this->take_error());
+            auto value = TRY(this->fix_position(visitor.visit_seq(CommaSeparated(*this))));
+            if (!this->eat(']', Error::Tag::ExpectedArrayEnd)) return ftl::Err(this->take_error());
+            return ftl::Ok(value);
         }
         template<typename V>
         Result<typename V::Value> deserialize_map(V visitor) {
-            if (TRY(next_char()) == '{') {
-                auto value = TRY(visitor.visit_map(CommaSeparated(*this)));
-                if (TRY(next_char()) == '}') {
-                    return ftl::Ok(value);
-                } else {
-                    return ftl::Err(Error::ExpectedMapEnd());
-                }
-            } else {
-                return ftl::Err(Error::ExpectedMap());
-            }
+            Nested nested(*this);
+            if (!nested.ok()) return ftl::Err(this->take_error());
+            if (!this->eat('{', Error::Tag::ExpectedMap)) return ftl::Err(this->take_error());
+            CommaSeparated access(*this);
+            access.skip = std::exchange(this->tag_key, nullptr);
+            auto value = TRY(this->fix_position(visitor.visit_map(access)));
+            if (!this->eat('}', Error::Tag::ExpectedMapEnd)) return ftl::Err(this->take_error());
+            return ftl::Ok(value);
         }
         template<typename V>
         Result<typename V::Value>
@@ -176,13 +606,189 @@ namespace serde_json::de {
         ) {
             (void)name;
             (void)fields;
+            SERDE_JSON_COUNT(structs[instrument::De]);
+            SERDE_JSON_TIME_TYPE(name, De);
             return deserialize_map(visitor);
         }
+        // Externally tagged enums are objects with a single entry
+        template<typename V>
+        Result<typename V::Value>
+        deserialize_enum(
+            const char *name,
+            const ftl::str variants[],
+            V visitor
+        ) {
+            (void)name;
+            (void)variants;
+            Nested nested(*this);
+            if (!nested.ok()) return ftl::Err(this->take_error());
+            if (!this->eat('{', Error::Tag::ExpectedEnum)) return ftl::Err(this->take_error());
+            auto value = TRY(this->fix_position(visitor.visit_map(CommaSeparated(*this))));
+            if (!this->eat('}', Error::Tag::ExpectedMapEnd)) return ftl::Err(this->take_error());
+            return ftl::Ok(value);
+        }
+        /**
+         * @brief   Object whose `tag` entry names its type
+         * @details When the tag is the first key, which is how serializers
+         *          write it, the remaining entries go to
+         *          visitor.visit_tagged_map and are decoded in one pass.
+         *          Otherwise the object is scanned once to find the tag, the
+         *          cursor goes back to its start and visitor.visit_tagged
+         *          decodes it as the named type, with the tag entry skipped
+         *          by the first map that gets opened. Neither path builds an
+         *          intermediate value. tag must outlive the call.
+         */
+        template<typename V>
+        Result<typename V::Value>
+        deserialize_internally_tagged(const ftl::str &tag, V visitor) {
+            const char *object = this->input;
+            if (this->peek() == '{') {
+                this->input++;
+                if (this->peek() == '"' && this->eat_key(tag)) {
+                    ftl::str name = this->parse_string();
+                    if (this->failed()) return ftl::Err(this->take_error());
+                    SERDE_JSON_COUNT(structs[instrument::De]);
+                    Nested nested(*this);
+                    if (!nested.ok()) return ftl::Err(this->take_error());
+                    CommaSeparated access(*this);
+                    access.first = false;
+                    auto value = TRY(this->fix_position(visitor.visit_tagged_map(name, access)));
+                    if (!this->eat('}', Error::Tag::ExpectedMapEnd)) return ftl::Err(this->take_error());
+                    return ftl::Ok(value);
+                }
+                if (this->failed()) return ftl::Err(this->take_error());
+                this->input = object;
+            }
+            SERDE_JSON_COUNT(tag_rescans);
+            ftl::str name;
+            bool found = this->find_tag(tag, name);
+            if (this->failed()) return ftl::Err(this->take_error());
+            if (!found) {
+                return ftl::Err(Error::missing_field(tag).at(this->start, object));
+            }
+            this->input = object;
+            this->tag_key = &tag;
+            auto res = this->fix_position(visitor.visit_tagged(name, *this));
+            this->tag_key = nullptr;
+            return res;
+        }
+        /**
+         * @brief   Deserializer for object keys
+         * @details JSON keys are always strings, so a map keyed by numbers
+         *          or bools reads them from inside the quotes. Everything
+         *          else goes straight to the underlying Deserializer.
+         */
+        struct MapKey {
+            using Error = error::Error;
+
+            Deserializer &de;
+
+            template<typename V, typename F>
+            Result<typename V::Value> quoted(F parse) {
+                if (!de.eat('"', Error::Tag::ExpectedString)) return ftl::Err(de.take_error());
+                auto value = TRY(parse());
+                if (!de.eat('"', Error::Tag::ExpectedString)) return ftl::Err(de.take_error());
+                return ftl::Ok(std::move(value));
+            }
+
+            template<typename V>
+            Result<typename V::Value> deserialize_any(V visitor) {
+                return de.deserialize_any(visitor);
+            }
+            template<typename V>
+            Result<typename V::Value> deserialize_option(V visitor) {
+                return visitor.visit_some(*this);
+            }
+            template<typename V>
+            Result<typename V::Value> deserialize_bool(V visitor) {
+                return quoted<V>([&] { return de.deserialize_bool(visitor); });
+            }
+            template<typename V>
+            Result<typename V::Value> deserialize_char(V visitor) {
+                return de.deserialize_char(visitor);
+            }
+            template<typename V>
+            Result<typename V::Value> deserialize_schar(V visitor) {
+                return quoted<V>([&] { return de.deserialize_schar(visitor); });
+            }
+            template<typename V>
+            Result<typename V::Value> deserialize_short(V visitor) {
+                return quoted<V>([&] { return de.deserialize_short(visitor); });
+            }
+            template<typename V>
+            Result<typename V::Value> deserialize_int(V visitor) {
+                return quoted<V>([&] { return de.deserialize_int(visitor); });
+            }
+            template<typename V>
+            Result<typename V::Value> deserialize_long(V visitor) {
+                return quoted<V>([&] { return de.deserialize_long(visitor); });
+            }
+            template<typename V>
+            Result<typename V::Value> deserialize_long_long(V visitor) {
+                return quoted<V>([&] { return de.deserialize_long_long(visitor); });
+            }
+            template<typename V>
+            Result<typename V::Value> deserialize_uchar(V visitor) {
+                return quoted<V>([&] { return de.deserialize_uchar(visitor); });
+            }
+            template<typename V>
+            Result<typename V::Value> deserialize_ushort(V visitor) {
+                return quoted<V>([&] { return de.deserialize_ushort(visitor); });
+            }
+            template<typename V>
+            Result<typename V::Value> deserialize_uint(V visitor) {
+                return quoted<V>([&] { return de.deserialize_uint(visitor); });
+            }
+            template<typename V>
+            Result<typename V::Value> deserialize_ulong(V visitor) {
+                return quoted<V>([&] { return de.deserialize_ulong(visitor); });
+            }
+            template<typename V>
+            Result<typename V::Value> deserialize_ulong_long(V visitor) {
+                return quoted<V>([&] { return de.deserialize_ulong_long(visitor); });
+            }
+            template<typename V>
+            Result<typename V::Value> deserialize_float(V visitor) {
+                return quoted<V>([&] { return de.deserialize_float(visitor); });
+            }
+            template<typename V>
+            Result<typename V::Value> deserialize_double(V visitor) {
+                return quoted<V>([&] { return de.deserialize_double(visitor); });
+            }
+            template<typename V>
+            Result<typename V::Value> deserialize_str(V visitor) {
+                return de.deserialize_str(visitor);
+            }
+            template<typename V>
+            Result<typename V::Value> deserialize_identifier(V visitor) {
+                return de.deserialize_identifier(visitor);
+            }
+            template<typename V>
+            Result<typename V::Value> deserialize_seq(V visitor) {
+                return de.deserialize_seq(visitor);
+            }
+            template<typename V>
+            Result<typename V::Value> deserialize_map(V visitor) {
+                return de.deserialize_map(visitor);
+            }
+            template<typename V>
+            Result<typename V::Value>
+            deserialize_struct(const char *name, const ftl::str fields[], V visitor) {
+                return de.deserialize_struct(name, fields, visitor);
+            }
+            template<typename V>
+            Result<typename V::Value>
+            deserialize_enum(const char *name, const ftl::str variants[], V visitor) {
+                return de.deserialize_enum(name, variants, visitor);
+            }
+        };
         struct CommaSeparated {
             using Error = error::Error;
 
             Deserializer &de;
             bool first;
+            // Entry left out of the map, the tag of an internally tagged variant
+            const ftl::str *skip = nullptr;
 
             CommaSeparated(Deserializer &de) : de(de), first(true) {}
 
@@ -190,32 +796,42 @@ namespace serde_json::de {
             template<typename K, typename Seed = serde::de::DeserializeSeed<K>>
             Result<ftl::Option<typename Seed::Value>>
             next_key_seed(K seed) {
-                if (TRY(de.peek_char()) == '}') {
+                if (de.peek() == '}') {
                     return ftl::Ok(ftl::Option<typename Seed::Value>(ftl::None()));
                 }
-                if (!first && TRY(de.next_char()) != ',') {
-                    return ftl::Err(Error::ExpectedMapComma());
+                if (!first && !de.eat(',', Error::Tag::ExpectedMapComma)) {
+                    return ftl::Err(de.take_error());
                 }
                 first = false;
-                return Seed::deserialize(seed, de)
+                if (skip != nullptr && de.skip_entry(*skip)) {
+                    skip = nullptr;
+                    if (de.failed()) return ftl::Err(de.take_error());
+                    return next_key_seed(seed);
+                }
+                MapKey key{de};
+                return Seed::deserialize(seed, key)
                     .map(ftl::Some<typename Seed::Value>);
             }
             template<typename V, typename Seed = serde::de::DeserializeSeed<V>>
             Result<typename Seed::Value> next_value_seed(V seed) {
-                if (TRY(de.next_char()) != ':') {
-                    return ftl::Err(Error::ExpectedMapColon());
+                if (!de.eat(':', Error::Tag::ExpectedMapColon)) {
+                    return ftl::Err(de.take_error());
                 }
                 return Seed::deserialize(seed, de);
             }
+            // Only asked for by containers that can reserve, it costs a scan
+            ftl::Option<size_t> size_hint() const {
+                return de.count_entries();
+            }
             // SeqAccess
             template<typename T, typename Seed = serde::de::DeserializeSeed<T>>
             Result<ftl::Option<typename Seed::Value>>
             next_element_seed(T seed) {
-                if (TRY(de.peek_char()) == ']') {
+                if (de.peek() == ']') {
                     return ftl::Ok(ftl::Option<typename Seed::Value>(ftl::None()));
                 }
-                if (!first && TRY(de.next_char()) != ',') {
-                    return ftl::Err(Error::ExpectedArrayComma());
+                if (!first && !de.eat(',', Error::Tag::ExpectedArrayComma)) {
+                    return ftl::Err(de.take_error());
                 }
                 first = false;
                 return Seed::deserialize(seed, de)
@@ -235,8 +851,17 @@ namespace serde_json::de {
                 return next_element_seed(ftl::PhantomData<T>{});
             }
         };
+#ifdef SERDE_CHECK_CONCEPTS
+        static_assert(serde::de::concepts::Deserializer<MapKey>);
         static_assert(serde::de::concepts::MapAccess<CommaSeparated>);
+        static_assert(serde::de::concepts::DeserializeSeed<
+                serde::de::AppendTo<std::vector<int>>, Deserializer>);
         // static_assert(serde::de::concepts::SeqAccess<CommaSeparated>);
+#endif
     };
+#ifdef SERDE_CHECK_CONCEPTS
     static_assert(serde::de::concepts::Deserializer<Deserializer>);
+#endif
 }
+
+#endif // !JSON_DE_H_
@@ -0,0 +1,113 @@
+#ifndef JSON_ENGINE_H_
+#define JSON_ENGINE_H_
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <ftl.hpp>
+
+#include "serde_json/json.hpp"
+
+namespace serde_json {
+    /**
+     * @brief   Configuration shared by the threads of a server, with
+     *          per-thread buffers reused from one call to the next
+     * @details Options are fixed at construction, so any number of threads
+     *          can use one Engine without locking. Everything that changes
+     *          lives in thread_local Scratch: the serializer's output buffer
+     *          and the deserializer's skip stack keep their capacity between
+     *          calls, so once they have grown to the largest document a
+     *          thread handles, write() and from_str() allocate nothing
+     *          beyond the values being decoded. Scratch is per formatter
+     *          type, Engines that share F share it.
+     */
+    template<typename F = ser::CompactFormatter>
+    struct Engine {
+        struct Options {
+            F formatter = F{};
+            // Containers a document may nest, see Deserializer::remaining_depth
+            size_t depth_limit = de::Deserializer::DEFAULT_DEPTH_LIMIT;
+            // Strict or Off. Replace needs an owner for the repaired
+            // strings, which from_str_lossy takes, and is Strict here.
+            utf8::Mode utf8_mode = utf8::Mode::Strict;
+            // A buffer grown past this by one large document is released on
+            // the next call instead of being held by the thread forever
+            size_t max_retained = 1 << 20;
+        };
+        struct Scratch {
+            std::string output;
+            std::string closers;
+        };
+
+        const Options options;
+
+        Engine() : options() {}
+        explicit Engine(Options options) : options(std::move(options)) {}
+
+        // This thread's buffers, created on its first call
+        static Scratch &scratch() {
+            thread_local Scratch local;
+            return local;
+        }
+
+        /**
+         * @brief   Serializes value into this thread's output buffer
+         * @details The view stays valid until the thread's next write() on an
+         *          Engine<F>. Copy it out, or use to_string(), to keep it.
+         */
+        template<serde::ser::concepts::Serialize T>
+        error::Result<std::string_view> write(const T &value) const {
+            Scratch &local = scratch();
+            ser::Serializer<F> serializer(options.formatter);
+            serializer.output = std::move(local.output);
+            if (serializer.output.capacity() > options.max_retained) {
+                serializer.output = std::string();
+            }
+            serializer.output.clear();
+            auto res = serde::ser::Serialize<T>::serialize(value, serializer);
+            local.output = std::move(serializer.output);
+            TRY(std::move(res));
+            SERDE_JSON_COUNT(bytes_produced, local.output.size());
+            return ftl::Ok(std::string_view(local.output));
+        }
+        // A copy of write()'s output, allocated once at its final size
+        template<serde::ser::concepts::Serialize T>
+        error::Result<std::string> to_string(const T &value) const {
+            std::string_view json = TRY(write(value));
+            return ftl::Ok(std::string(json));
+        }
+
+        template<typename T>
+        error::Result<T> from_str(const char *json) const {
+            de::Deserializer deserializer(json);
+            return decode(ftl::PhantomData<T>{}, deserializer);
+        }
+        template<typename T>
+        error::Result<T> from_slice(const char *json, size_t len) const {
+            de::Deserializer deserializer(json, len);
+            return decode(ftl::PhantomData<T>{}, deserializer);
+        }
+        template<serde::de::concepts::DeserializeSeed S>
+        error::Result<typename serde::de::DeserializeSeed<S>::Value>
+        from_str_seed(const S &seed, const char *json) const {
+            de::Deserializer deserializer(json);
+            return decode(seed, deserializer);
+        }
+
+    private:
+        template<typename S>
+        error::Result<typename serde::de::DeserializeSeed<S>::Value>
+        decode(const S &seed, de::Deserializer &deserializer) const {
+            Scratch &local = scratch();
+            if (local.closers.capacity() > options.max_retained) local.closers = std::string();
+            deserializer.remaining_depth = options.depth_limit;
+            deserializer.utf8_mode = options.utf8_mode;
+            deserializer.scratch = &local.closers;
+            return detail::from_deserializer(seed, deserializer);
+        }
+    };
+}
+
+#endif // !JSON_ENGINE_H_
@@ -0,0 +1,98 @@
+#ifndef JSON_FILE_H_
+#define JSON_FILE_H_
+
+/**
+ * Reading JSON straight from a file mapping, POSIX only. Kept out of json.hpp
+ * so that the system headers are only parsed by the files that use it.
+ */
+
+#include <cerrno>
+#include <cstddef>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "serde_json/json.hpp"
+
+namespace serde_json {
+    /**
+     * @brief   Read-only mapping of a whole file
+     * @details Pages are read in by the kernel as the parser reaches them,
+     *          MADV_SEQUENTIAL lets it read ahead and drop what is behind.
+     *          The bytes are not NUL terminated. An empty file maps to an
+     *          empty range.
+     */
+    struct Mmap {
+        const char *data = nullptr;
+        size_t size = 0;
+
+        Mmap() = default;
+        Mmap(const Mmap &) = delete;
+        Mmap &operator=(const Mmap &) = delete;
+        Mmap(Mmap &&other) noexcept
+            : data(std::exchange(other.data, nullptr)),
+              size(std::exchange(other.size, 0)) {}
+        Mmap &operator=(Mmap &&other) noexcept {
+            std::swap(data, other.data);
+            std::swap(size, other.size);
+            return *this;
+        }
+        ~Mmap() {
+            if (data != nullptr) munmap(const_cast<char *>(data), size);
+        }
+
+        static error::Result<Mmap> open(const char *path) {
+            int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+            if (fd < 0) return ftl::Err(error::Error::io("open", errno));
+            struct stat st;
+            if (fstat(fd, &st) < 0) {
+                int code = errno;
+                close(fd);
+                return ftl::Err(error::Error::io("fstat", code));
+            }
+            Mmap map;
+            if (st.st_size > 0) {
+                void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (addr == MAP_FAILED) {
+                    int code = errno;
+                    close(fd);
+                    return ftl::Err(error::Error::io("mmap", code));
+                }
+                madvise(addr, st.st_size, MADV_SEQUENTIAL);
+                map.data = static_cast<const char *>(addr);
+                map.size = st.st_size;
+            }
+            // The mapping keeps the file alive on its own
+            close(fd);
+            return ftl::Ok(std::move(map));
+        }
+    };
+
+    /**
+     * @brief   Value deserialized from a mapped file, with the mapping
+     * @details Borrowed fields (ftl::str) point into map, so they stay
+     *          valid exactly as long as this object, moves included.
+     */
+    template<typename T>
+    struct Mapped {
+        Mmap map;
+        T value;
+    };
+
+    /**
+     * @brief   Deserializes the file at path without copying it into memory
+     * @details Parse errors come detached from from_slice, with their line
+     *          and column counted before the file is unmapped.
+     */
+    template<typename T>
+    error::Result<Mapped<T>> from_file(const char *path) {
+        Mmap map = TRY(Mmap::open(path));
+        T value = TRY(from_slice<T>(map.data, map.size));
+        return ftl::Ok(Mapped<T>{std::move(map), std::move(value)});
+    }
+}
+
+#endif // !JSON_FILE_H_
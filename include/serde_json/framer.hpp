@@ -0,0 +1,157 @@
+#ifndef JSON_FRAMER_H_
+#define JSON_FRAMER_H_
+
+#include <cstddef>
+#include <string>
+#include <utility>
+
+#include <ftl.hpp>
+
+#include "serde_json/json.hpp"
+
+namespace serde_json {
+    /**
+     * @brief   Splits a chunked stream into whole JSON documents
+     * @details Only frames documents, it does not decode them as they
+     *          arrive: each one is buffered whole and then decoded with
+     *          from_slice, because the visitors are plain recursive calls
+     *          and derived structs may borrow ftl::str fields from the
+     *          input. Peak memory tracks the largest document, not the
+     *          size of a chunk.
+     *
+     *          feed() appends a chunk and advances a structural scanner
+     *          (nesting depth, inside a string, after a backslash) over the
+     *          new bytes only, so no byte is looked at twice however the
+     *          body is split, and the caller never blocks: it feeds what
+     *          the socket returned and asks again later. Once ready(), take() decodes the document
+     *          with the regular Deserializer. Bytes after the document are
+     *          kept as the start of the next one, for pipelined bodies,
+     *          and whitespace between documents is skipped. A document
+     *          that is a bare number only ends with the stream: call
+     *          take() after the last chunk to decode it anyway.
+     */
+    template<typename T>
+    struct DocumentFramer {
+        std::string buffer;
+        // Start of the current document, what is before was taken already
+        size_t begin = 0;
+        // Scanner state, bytes before scanned have been looked at
+        size_t scanned = 0;
+        size_t depth = 0;
+        bool in_string = false;
+        bool escaped = false;
+        bool started = false;
+        // End of the current document once it is complete, 0 before
+        size_t complete = 0;
+
+        /**
+         * @brief   Appends chunk, true once a whole document has arrived
+         * @details Fails on a closing bracket without an opening one, which
+         *          can not turn valid with more input. Everything else is
+         *          left to the decoder.
+         */
+        error::Result<bool> feed(const char *chunk, size_t len) {
+            if (this->begin != 0) {
+                this->buffer.erase(0, this->begin);
+                this->scanned -= this->begin;
+                if (this->complete != 0) this->complete -= this->begin;
+                this->begin = 0;
+            }
+            this->buffer.append(chunk, len);
+            return this->scan();
+        }
+        bool ready() const {
+            return this->complete != 0;
+        }
+        /**
+         * @brief   Decodes the current document
+         * @details Borrowed fields of the result point into the buffer and
+         *          stay valid until the next feed(). Before ready() this is
+         *          the end of the stream: a bare number decodes, anything
+         *          else cut short fails with Eof like from_str would.
+         *          Afterwards ready() tells whether the bytes that came
+         *          after the document already hold the next one.
+         */
+        error::Result<T> take() {
+            size_t start = this->begin;
+            size_t stop = this->ready() ? this->complete : this->buffer.size();
+            this->begin = stop;
+            this->scanned = stop;
+            this->depth = 0;
+            this->in_string = false;
+            this->escaped = false;
+            this->started = false;
+            this->complete = 0;
+            auto res = from_slice<T>(this->buffer.data() + start, stop - start);
+            (void)this->scan();
+            return res;
+        }
+
+    private:
+        error::Result<bool> scan() {
+            if (this->ready()) return ftl::Ok(true);
+            const char *data = this->buffer.data();
+            for (size_t i = this->scanned; i < this->buffer.size(); i++) {
+                char ch = data[i];
+                if (this->in_string) {
+                    if (this->escaped) {
+                        this->escaped = false;
+                    } else if (ch == '\\') {
+                        this->escaped = true;
+                    } else if (ch == '"') {
+                        this->in_string = false;
+                        if (this->depth == 0) return this->done(i + 1);
+                    }
+                    continue;
+                }
+                switch (ch) {
+                case '"':
+                    this->in_string = true;
+                    this->started = true;
+                    break;
+                case '{':
+                case '[':
+                    this->depth++;
+                    this->started = true;
+                    break;
+                case '}':
+                case ']':
+                    if (this->depth == 0) {
+                        this->scanned = i;
+                        return ftl::Err(error::Error::Syntax()
+                                .at(data + this->begin, data + i).detach());
+                    }
+                    if (--this->depth == 0) return this->done(i + 1);
+                    break;
+                case ' ':
+                case '\t':
+                case '\n':
+                case '\r':
+                    // Whitespace ends a bare scalar, before a document it is dropped
+                    if (this->depth != 0) break;
+                    if (this->started) return this->done(i);
+                    this->begin = i + 1;
+                    break;
+                default:
+                    // A bare scalar ends at the first byte that is not part of it
+                    if (this->depth == 0 && this->started
+                            && !de::Deserializer::is_number_char(ch)
+                            && (ch < 'a' || ch > 'z')) {
+                        return this->done(i);
+                    }
+                    this->started = true;
+                    break;
+                }
+            }
+            this->scanned = this->buffer.size();
+            return ftl::Ok(false);
+        }
+        error::Result<bool> done(size_t end) {
+            this->scanned = end;
+            this->complete = end;
+            return ftl::Ok(true);
+        }
+    };
+}
+
+#endif // !JSON_FRAMER_H_
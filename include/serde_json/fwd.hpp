@@ -0,0 +1,43 @@
+#ifndef JSON_FWD_H_
+#define JSON_FWD_H_
+
+#include <iosfwd>
+
+/**
+ * Forward declarations of the serde and serde_json types, for headers that
+ * only name them (in signatures, friend declarations, pointers) and should
+ * not pay for parsing the library and ftl.hpp.
+ *
+ * Default template arguments live here, the defining headers leave them out.
+ */
+
+namespace serde {
+    namespace ser {
+        template<typename T>
+        struct Serialize;
+    }
+    namespace de {
+        template<typename T>
+        struct Deserialize;
+        template<typename T>
+        struct DeserializeSeed;
+    }
+}
+
+namespace serde_json {
+    namespace error {
+        struct Error;
+    }
+    namespace ser {
+        struct CompactFormatter;
+        struct PrettyFormatter;
+        struct CanonicalFormatter;
+        template<typename F = CompactFormatter, typename W = std::string>
+        struct Serializer;
+    }
+    namespace de {
+        struct Deserializer;
+    }
+}
+
+#endif // !JSON_FWD_H_
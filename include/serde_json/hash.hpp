@@ -0,0 +1,141 @@
+#ifndef JSON_HASH_H_
+#define JSON_HASH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#include <ftl.hpp>
+
+namespace serde_json {
+    /**
+     * @brief   Streaming XXH64, usable as the output of a Serializer
+     * @details Bytes are collected into a small buffer and hashed 32 at a
+     *          time whenever it fills, so a document hashed this way is
+     *          never held in memory. digest() gives the same value as the
+     *          reference XXH64 of the concatenated bytes and can be called
+     *          at any point without disturbing the state.
+     */
+    struct Xxh64 {
+        static constexpr uint64_t PRIME_1 = 0x9E3779B185EBCA87;
+        static constexpr uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4F;
+        static constexpr uint64_t PRIME_3 = 0x165667B19E3779F9;
+        static constexpr uint64_t PRIME_4 = 0x85EBCA77C2B2AE63;
+        static constexpr uint64_t PRIME_5 = 0x27D4EB2F165667C5;
+
+        explicit Xxh64(uint64_t seed = 0)
+            : seed(seed),
+              acc{seed + PRIME_1 + PRIME_2, seed + PRIME_2, seed, seed - PRIME_1} {}
+
+        // One-shot hash of [data, data + len)
+        static uint64_t hash(const char *data, size_t len, uint64_t seed = 0) {
+            Xxh64 state(seed);
+            state.append(data, len);
+            return state.digest();
+        }
+
+        void append(const char *data, size_t len) {
+            total += len;
+            // Serializers write a few bytes at a time, those only get copied
+            if (len <= sizeof(pending) - buffered) {
+                if (len != 0) memcpy(pending + buffered, data, len);
+                buffered += len;
+                return;
+            }
+            absorb(reinterpret_cast<const unsigned char *>(data), len);
+        }
+        void operator+=(char ch) { append(&ch, 1); }
+        void operator+=(const char *str) { append(str, strlen(str)); }
+        void operator+=(std::string_view str) { append(str.data(), str.size()); }
+        void operator+=(const ftl::str &str) {
+            if (str.len() != 0) append(&*str.begin(), str.len());
+        }
+
+        // Bytes hashed so far
+        size_t size() const { return total; }
+
+        uint64_t digest() const {
+            uint64_t lanes[4] = {acc[0], acc[1], acc[2], acc[3]};
+            const unsigned char *p = pending;
+            const unsigned char *end = pending + buffered;
+            for (; (size_t)(end - p) >= STRIPE; p += STRIPE) consume(lanes, p);
+
+            uint64_t h;
+            if (total >= STRIPE) {
+                h = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+                for (uint64_t v : lanes) {
+                    h ^= round(0, v);
+                    h = h * PRIME_1 + PRIME_4;
+                }
+            } else {
+                h = seed + PRIME_5;
+            }
+            h += total;
+
+            for (; end - p >= 8; p += 8) {
+                h ^= round(0, read64(p));
+                h = rotl(h, 27) * PRIME_1 + PRIME_4;
+            }
+            if (end - p >= 4) {
+                h ^= read32(p) * PRIME_1;
+                h = rotl(h, 23) * PRIME_2 + PRIME_3;
+                p += 4;
+            }
+            for (; p != end; p++) {
+                h ^= *p * PRIME_5;
+                h = rotl(h, 11) * PRIME_1;
+            }
+
+            h ^= h >> 33;
+            h *= PRIME_2;
+            h ^= h >> 29;
+            h *= PRIME_3;
+            h ^= h >> 32;
+            return h;
+        }
+
+    private:
+        uint64_t seed;
+        uint64_t acc[4];
+        uint64_t total = 0;
+        // Bytes not hashed yet, starting on a stripe boundary
+        unsigned char pending[256];
+        size_t buffered = 0;
+
+        static constexpr size_t STRIPE = 32;
+
+        static uint64_t rotl(uint64_t x, int r) {
+            return (x << r) | (x >> (64 - r));
+        }
+        static uint64_t round(uint64_t acc, uint64_t input) {
+            acc += input * PRIME_2;
+            return rotl(acc, 31) * PRIME_1;
+        }
+        // XXH64 is defined on little endian lanes
+        static uint64_t read64(const unsigned char *p) {
+            uint64_t res = 0;
+            for (int i = 7; i >= 0; i--) res = res << 8 | p[i];
+            return res;
+        }
+        static uint64_t read32(const unsigned char *p) {
+            return (uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24;
+        }
+        static void consume(uint64_t (&lanes)[4], const unsigned char *p) {
+            for (int i = 0; i < 4; i++) lanes[i] = round(lanes[i], read64(p + 8 * i));
+        }
+        // Hashes the full pending buffer and the stripes of data after it
+        [[gnu::noinline]] void absorb(const unsigned char *data, size_t len) {
+            size_t fill = sizeof(pending) - buffered;
+            memcpy(pending + buffered, data, fill);
+            for (size_t i = 0; i < sizeof(pending); i += STRIPE) consume(acc, pending + i);
+            data += fill;
+            len -= fill;
+            for (; len >= STRIPE; data += STRIPE, len -= STRIPE) consume(acc, data);
+            if (len != 0) memcpy(pending, data, len);
+            buffered = len;
+        }
+    };
+}
+
+#endif // !JSON_HASH_H_
@@ -0,0 +1,287 @@
+#ifndef JSON_INSTRUMENT_H_
+#define JSON_INSTRUMENT_H_
+
+/**
+ * Optional counters around serde_json::ser::Serializer and de::Deserializer.
+ * Compile with -DSERDE_JSON_INSTRUMENT to enable them; without it every hook
+ * below expands to nothing and this header pulls in no code.
+ *
+ * Each thread bumps its own counter block, so the hot path never locks.
+ * aggregate() sums the blocks of all live threads plus the ones that exited,
+ * and dump() prints that sum, with per-type counts and inclusive time keyed
+ * by the name passed to serialize_struct/deserialize_struct.
+ */
+
+#ifdef SERDE_JSON_INSTRUMENT
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+namespace serde_json::instrument {
+    using Counter = std::atomic<uint64_t>;
+
+    // Only the owning thread writes, readers may race with it
+    inline void bump(Counter &counter, uint64_t n = 1) {
+        counter.store(counter.load(std::memory_order_relaxed) + n,
+                std::memory_order_relaxed);
+    }
+
+    // ftl::str names from serialize_struct
+    template<typename S>
+    std::string_view view(const S &str) {
+        return str.len() ? std::string_view(&*str.begin(), str.len()) : std::string_view();
+    }
+
+    inline uint64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    enum Direction { Ser, De };
+
+    struct TypeStats {
+        std::string_view name;
+        uint64_t count[2];
+        uint64_t ns[2];
+    };
+
+    struct Stats {
+        uint64_t bytes_consumed = 0;
+        uint64_t bytes_produced = 0;
+        uint64_t structs[2] = {};
+        uint64_t seqs[2] = {};
+        uint64_t escaped_strings = 0;
+        uint64_t tag_rescans = 0;
+        uint64_t output_growths = 0;
+        std::vector<TypeStats> types;
+
+        void add_type(const TypeStats &stats) {
+            auto it = std::find_if(types.begin(), types.end(),
+                    [&](const TypeStats &t) { return t.name == stats.name; });
+            if (it == types.end()) {
+                types.push_back(stats);
+                return;
+            }
+            for (int dir : {Ser, De}) {
+                it->count[dir] += stats.count[dir];
+                it->ns[dir] += stats.ns[dir];
+            }
+        }
+        Stats &operator+=(const Stats &other) {
+            bytes_consumed += other.bytes_consumed;
+            bytes_produced += other.bytes_produced;
+            for (int dir : {Ser, De}) {
+                structs[dir] += other.structs[dir];
+                seqs[dir] += other.seqs[dir];
+            }
+            escaped_strings += other.escaped_strings;
+            tag_rescans += other.tag_rescans;
+            output_growths += other.output_growths;
+            for (auto &type : other.types) add_type(type);
+            return *this;
+        }
+    };
+
+    struct Block {
+        // Open addressing on the name pointer; names are string literals
+        static constexpr size_t TYPE_SLOTS = 256;
+        struct TypeSlot {
+            std::atomic<const char *> name{nullptr};
+            std::atomic<size_t> len{0};
+            Counter count[2];
+            Counter ns[2];
+        };
+
+        Counter bytes_consumed{0};
+        Counter bytes_produced{0};
+        Counter structs[2]{};
+        Counter seqs[2]{};
+        Counter escaped_strings{0};
+        Counter tag_rescans{0};
+        Counter output_growths{0};
+        std::array<TypeSlot, TYPE_SLOTS> types;
+
+        Block();
+        ~Block();
+
+        void time_type(std::string_view name, Direction dir, uint64_t ns) {
+            size_t hash = reinterpret_cast<uintptr_t>(name.data()) >> 3;
+            for (size_t i = 0; i < TYPE_SLOTS; i++) {
+                TypeSlot &slot = types[(hash + i) % TYPE_SLOTS];
+                const char *slot_name = slot.name.load(std::memory_order_relaxed);
+                if (slot_name == nullptr) {
+                    slot.len.store(name.size(), std::memory_order_relaxed);
+                    slot.name.store(name.data(), std::memory_order_release);
+                } else if (slot_name != name.data()) {
+                    continue;
+                }
+                bump(slot.count[dir]);
+                bump(slot.ns[dir], ns);
+                return;
+            }
+            // table full, drop the sample
+        }
+
+        Stats snapshot() const {
+            Stats stats;
+            stats.bytes_consumed = bytes_consumed.load(std::memory_order_relaxed);
+            stats.bytes_produced = bytes_produced.load(std::memory_order_relaxed);
+            for (int dir : {Ser, De}) {
+                stats.structs[dir] = structs[dir].load(std::memory_order_relaxed);
+                stats.seqs[dir] = seqs[dir].load(std::memory_order_relaxed);
+            }
+            stats.escaped_strings = escaped_strings.load(std::memory_order_relaxed);
+            stats.tag_rescans = tag_rescans.load(std::memory_order_relaxed);
+            stats.output_growths = output_growths.load(std::memory_order_relaxed);
+            for (auto &slot : types) {
+                const char *name = slot.name.load(std::memory_order_acquire);
+                if (name == nullptr) continue;
+                TypeStats type{std::string_view(name, slot.len.load(std::memory_order_relaxed)), {}, {}};
+                for (int dir : {Ser, De}) {
+                    type.count[dir] = slot.count[dir].load(std::memory_order_relaxed);
+                    type.ns[dir] = slot.ns[dir].load(std::memory_order_relaxed);
+                }
+                stats.add_type(type);
+            }
+            return stats;
+        }
+    };
+
+    struct Registry {
+        std::mutex lock;
+        std::vector<const Block *> live;
+        Stats retired;
+
+        static Registry &get() {
+            static Registry registry;
+            return registry;
+        }
+    };
+
+    inline Block::Block() {
+        Registry &registry = Registry::get();
+        std::lock_guard guard(registry.lock);
+        registry.live.push_back(this);
+    }
+    inline Block::~Block() {
+        Registry &registry = Registry::get();
+        std::lock_guard guard(registry.lock);
+        registry.retired += this->snapshot();
+        std::erase(registry.live, this);
+    }
+
+    inline Block &local() {
+        thread_local Block block;
+        return block;
+    }
+
+    inline Stats aggregate() {
+        Registry &registry = Registry::get();
+        std::lock_guard guard(registry.lock);
+        Stats total = registry.retired;
+        for (const Block *block : registry.live) total += block->snapshot();
+        return total;
+    }
+
+    inline void dump(std::ostream &out) {
+        Stats stats = aggregate();
+        out << "serde_json: consumed " << stats.bytes_consumed
+            << " B, produced " << stats.bytes_produced << " B\n"
+            << "  structs ser/de: " << stats.structs[Ser] << '/' << stats.structs[De] << '\n'
+            << "  seqs    ser/de: " << stats.seqs[Ser] << '/' << stats.seqs[De] << '\n'
+            << "  escaped strings: " << stats.escaped_strings << '\n'
+            << "  internal tag rescans: " << stats.tag_rescans << '\n'
+            << "  output buffer growths: " << stats.output_growths << '\n';
+        std::sort(stats.types.begin(), stats.types.end(),
+                [](const TypeStats &a, const TypeStats &b) {
+                    return a.ns[Ser] + a.ns[De] > b.ns[Ser] + b.ns[De];
+                });
+        for (auto &type : stats.types) {
+            out << "  " << type.name
+                << ": ser " << type.count[Ser] << "x " << type.ns[Ser] << " ns"
+                << ", de " << type.count[De] << "x " << type.ns[De] << " ns\n";
+        }
+    }
+
+    // Inclusive time spent in one struct, measured on this thread
+    struct ScopedTimer {
+        std::string_view name;
+        Direction dir;
+        uint64_t start;
+        ScopedTimer(std::string_view name, Direction dir)
+            : name(name), dir(dir), start(now_ns()) {}
+        ~ScopedTimer() { local().time_type(name, dir, now_ns() - start); }
+    };
+
+    // serialize_struct and end() are separate calls, so the serializer keeps
+    // its open structs on a small stack. Deeper nesting is not timed. An error
+    // returns through TRY without calling end(), the structs it left open are
+    // popped when the serializer goes away, so nothing has to pair them by hand.
+    struct TimerStack {
+        static constexpr size_t DEPTH = 32;
+        std::string_view names[DEPTH];
+        uint64_t starts[DEPTH];
+        size_t depth = 0;
+
+        TimerStack() = default;
+        TimerStack(const TimerStack &) = delete;
+        TimerStack &operator=(const TimerStack &) = delete;
+        ~TimerStack() {
+            while (depth > 0) pop();
+        }
+
+        void push(std::string_view name) {
+            if (depth < DEPTH) {
+                names[depth] = name;
+                starts[depth] = now_ns();
+            }
+            depth++;
+        }
+        void pop() {
+            depth--;
+            if (depth < DEPTH) {
+                local().time_type(names[depth], Ser, now_ns() - starts[depth]);
+            }
+        }
+    };
+
+    // Counts capacity changes of the serializer's output buffer. Allocations
+    // anywhere else, like the strings and containers Deserialize builds, are
+    // not seen here.
+    struct CapacityTracker {
+        size_t capacity = 0;
+        template<typename Buf>
+        void check(const Buf &buf) {
+            if constexpr (!requires { buf.capacity(); }) return;
+            else if (buf.capacity() != capacity) {
+                capacity = buf.capacity();
+                bump(local().output_growths);
+            }
+        }
+    };
+}
+
+#define SERDE_JSON_COUNT(COUNTER, ...) \
+    ::serde_json::instrument::bump(::serde_json::instrument::local().COUNTER __VA_OPT__(,) __VA_ARGS__)
+#define SERDE_JSON_TIME_TYPE(NAME, DIR) \
+    ::serde_json::instrument::ScopedTimer ___type_timer(NAME, ::serde_json::instrument::DIR)
+#define SERDE_JSON_INSTRUMENT_MEMBER(DECL) DECL;
+#define SERDE_JSON_INSTRUMENT_DO(...) __VA_ARGS__
+
+#else
+
+#define SERDE_JSON_COUNT(COUNTER, ...) ((void)0)
+#define SERDE_JSON_TIME_TYPE(NAME, DIR) ((void)0)
+#define SERDE_JSON_INSTRUMENT_MEMBER(DECL)
+#define SERDE_JSON_INSTRUMENT_DO(...) ((void)0)
+
+#endif // SERDE_JSON_INSTRUMENT
+
+#endif // !JSON_INSTRUMENT_H_
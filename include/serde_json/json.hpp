@@ -4,27 +4,165 @@
 #include "fst/fst.hpp"
 #include "serde_json/ser.hpp"
 #include "serde_json/de.hpp"
+#include "serde/validate.hpp"
 #include <cstring>
 
 namespace serde_json {
+    template<serde::ser::concepts::Serialize T, typename F>
+    error::Result<std::string> to_string_with(const T &value, F formatter) {
+        serde_json::ser::Serializer<F> serializer(formatter);
+        TRY(serde::ser::Serialize<T>::serialize(value, serializer));
+        SERDE_JSON_COUNT(bytes_produced, serializer.output.size());
+        return ftl::Ok(std::move(serializer.output));
+    }
     template<serde::ser::concepts::Serialize T>
     error::Result<std::string> to_string(const T &value) {
-        serde_json::ser::Serializer serializer;
-        serde::ser::Serialize<T>::serialize(value, serializer).unwrap();
-        return ftl::Ok(serializer.output);
+        return to_string_with(value, ser::CompactFormatter{});
+    }
+    template<serde::ser::concepts::Serialize T>
+    error::Result<std::string> to_string_pretty(const T &value) {
+        return to_string_with(value, ser::PrettyFormatter{});
+    }
+    template<serde::ser::concepts::Serialize T>
+    error::Result<std::string> to_string_canonical(const T &value) {
+        return to_string_with(value, ser::CanonicalFormatter{});
+    }
+    /**
+     * @brief   XXH64 of the canonical form of value
+     * @details Equal to Xxh64::hash of to_string_canonical(value), but the
+     *          bytes are hashed as they are produced, the document itself
+     *          is never in memory.
+     */
+    template<serde::ser::concepts::Serialize T>
+    error::Result<uint64_t> hash_canonical(const T &value, uint64_t seed = 0) {
+        ser::Serializer<ser::CanonicalFormatter, Xxh64> serializer(
+                ser::CanonicalFormatter{}, Xxh64(seed));
+        TRY(serde::ser::Serialize<T>::serialize(value, serializer));
+        SERDE_JSON_COUNT(bytes_produced, serializer.output.size());
+        return ftl::Ok(serializer.output.digest());
+    }
+    /**
+     * @brief   Serializes value into buf, without allocating
+     * @details Fails with BufferFull when the output does not fit, which a
+     *          ser::Buffer<T> rules out for bounded types. The view points
+     *          into buf.
+     */
+    template<serde::ser::concepts::Serialize T>
+    error::Result<std::string_view> to_span(const T &value, std::span<char> buf) {
+        ser::Serializer<ser::CompactFormatter, ser::SpanWriter> serializer(
+                ser::CompactFormatter{}, ser::SpanWriter(buf));
+        TRY(serde::ser::Serialize<T>::serialize(value, serializer));
+        TRY(serializer.check_full());
+        SERDE_JSON_COUNT(bytes_produced, serializer.output.size());
+        return ftl::Ok(serializer.output.view());
+    }
+
+    namespace detail {
+        // Deserializes a value that has to span the whole input
+        template<typename S, typename Seed = serde::de::DeserializeSeed<S>>
+        error::Result<typename Seed::Value>
+        deserialize_all(const S &seed, de::Deserializer &deserializer) {
+            auto value = TRY(Seed::deserialize(seed, deserializer));
+            SERDE_JSON_COUNT(bytes_consumed, deserializer.input - deserializer.start);
+            if (deserializer.input == deserializer.end) {
+                return ftl::Ok(std::move(value));
+            } else {
+                return ftl::Err(deserializer.error(error::Error::TrailingCharacters()));
+            }
+        }
+        // As deserialize_all, the error is detached before the input can go away
+        template<typename S, typename Seed = serde::de::DeserializeSeed<S>>
+        error::Result<typename Seed::Value>
+        from_deserializer(const S &seed, de::Deserializer &deserializer) {
+            return deserialize_all(seed, deserializer).map_err([](error::Error err) {
+                return err.detach();
+            });
+        }
+        template<typename T>
+        error::Result<void> validate_all(de::Deserializer &deserializer) {
+            TRY(serde::de::Validate<T>::validate(deserializer));
+            SERDE_JSON_COUNT(bytes_consumed, deserializer.input - deserializer.start);
+            if (deserializer.input == deserializer.end) {
+                return ftl::Ok();
+            } else {
+                return ftl::Err(deserializer.error(error::Error::TrailingCharacters()));
+            }
+        }
     }
 
     /* template<serde::de::Deserializable T> */
     template<typename T>
     error::Result<T> from_str(const char *json) {
         de::Deserializer deserializer(json);
-        T t = TRY(serde::de::Deserialize<T>::deserialize(deserializer));
-        if (strlen(deserializer.input) == 0) {
-            return ftl::Ok(t);
-        } else {
-            return ftl::Err(error::Error::TrailingCharacters());
-        }
+        return detail::from_deserializer(ftl::PhantomData<T>{}, deserializer);
+    }
+    // json does not have to be NUL terminated
+    template<typename T>
+    error::Result<T> from_slice(const char *json, size_t len) {
+        de::Deserializer deserializer(json, len);
+        return detail::from_deserializer(ftl::PhantomData<T>{}, deserializer);
+    }
+    /**
+     * @brief   Deserializes json, replacing invalid UTF-8 in strings with U+FFFD
+     * @details Strings that needed it are repaired into copies appended to
+     *          repaired, borrowed fields of the result point there, so it
+     *          has to live as long as the result. Valid strings are still
+     *          borrowed from json.
+     */
+    template<typename T>
+    error::Result<T> from_str_lossy(const char *json, std::deque<std::string> &repaired) {
+        de::Deserializer deserializer(json);
+        deserializer.utf8_mode = utf8::Mode::Replace;
+        deserializer.repaired = &repaired;
+        return detail::from_deserializer(ftl::PhantomData<T>{}, deserializer);
+    }
+    /**
+     * @brief   Deserializes json with a stateful seed
+     * @details from_str_seed(serde::de::Extend<std::vector<T>>{&vec}, json)
+     *          appends the elements of a JSON array to vec.
+     */
+    template<serde::de::concepts::DeserializeSeed S>
+    error::Result<typename serde::de::DeserializeSeed<S>::Value>
+    from_str_seed(const S &seed, const char *json) {
+        de::Deserializer deserializer(json);
+        return detail::from_deserializer(seed, deserializer);
+    }
+
+    /**
+     * @brief   Checks that json deserializes as T, without building the T
+     * @details Fails with the same error from_str would, but derived
+     *          structs, vectors and maps are only walked, so nothing is
+     *          allocated for them.
+     */
+    template<typename T>
+    error::Result<void> validate(const char *json) {
+        de::Deserializer deserializer(json);
+        return detail::validate_all<T>(deserializer).map_err([](error::Error err) {
+            return err.detach();
+        });
     }
 }
 
+/**
+ * Explicit instantiation of the JSON entry points for one type.
+ * SERDE_JSON_EXTERN(T) next to the type's derive stops every file that
+ * includes it from instantiating them again, SERDE_JSON_INSTANTIATE(T) in
+ * one source file provides them. T must not contain commas, use an alias.
+ */
+#define __SERDE_JSON_TEMPLATES(PREFIX, T)                                     \
+    PREFIX template ::serde_json::error::Result<std::string>                  \
+        serde_json::to_string<T>(const T &);                                  \
+    PREFIX template ::serde_json::error::Result<std::string>                  \
+        serde_json::to_string_pretty<T>(const T &);                           \
+    PREFIX template ::serde_json::error::Result<T>                            \
+        serde_json::from_str<T>(const char *);                                \
+    PREFIX template ::serde_json::error::Result<void>                         \
+        serde::ser::Serialize<T>::serialize(                                  \
+            const T &, ::serde_json::ser::Serializer<> &);                    \
+    PREFIX template ::serde_json::error::Result<T>                            \
+        serde::de::Deserialize<T>::deserialize(::serde_json::de::Deserializer &);
+
+#define SERDE_JSON_EXTERN(T) __SERDE_JSON_TEMPLATES(extern, T)
+#define SERDE_JSON_INSTANTIATE(T) __SERDE_JSON_TEMPLATES(, T)
+
 #endif // JSON_H_
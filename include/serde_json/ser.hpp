@@ -1,25 +1,233 @@
 #ifndef JSON_SER_H_
 #define JSON_SER_H_
 
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstring>
 #include <functional>
+#include <limits>
+#include <span>
 #include <string>
+#include <string_view>
+#include <type_traits>
 
 #include "fst/fst.hpp"
 #include "error.hpp"
+#include "fwd.hpp"
+#include "hash.hpp"
+#include "instrument.hpp"
 #include "ftl.hpp"
+#include "serde/fields.hpp"
 #include "serde/ser.hpp"
 
 namespace serde_json::ser {
     using error::Result;
 
+    /**
+     * @brief   Formatter policies decide the punctuation and whitespace around values
+     * @details The Serializer calls these around every array element and
+     *          object entry and tells them whether it is the first one, or
+     *          on close whether the container was empty. They write through
+     *          `out += ...`, so they work with any output that takes chars
+     *          and string literals.
+     *          A custom formatter derives from one of these and shadows the
+     *          hooks it wants to change.
+     */
+    struct CompactFormatter {
+        template<typename W> void begin_array(W &out) { out += '['; }
+        template<typename W> void end_array(W &out, bool empty) { (void)empty; out += ']'; }
+        template<typename W> void begin_array_value(W &out, bool first) { if (!first) out += ','; }
+        template<typename W> void end_array_value(W &out) { (void)out; }
+
+        template<typename W> void begin_object(W &out) { out += '{'; }
+        template<typename W> void end_object(W &out, bool empty) { (void)empty; out += '}'; }
+        template<typename W> void begin_object_key(W &out, bool first) { if (!first) out += ','; }
+        template<typename W> void end_object_key(W &out) { (void)out; }
+        template<typename W> void begin_object_value(W &out) { out += ':'; }
+        template<typename W> void end_object_value(W &out) { (void)out; }
+    };
+
+    /**
+     * @brief   Output that is the same for equal values, for hashing
+     * @details Compact, with struct fields and map entries sorted by key and
+     *          numbers in their shortest round trip form (to_chars). -0 is
+     *          written as 0, NaN and infinities fail. Values a Serialize
+     *          impl writes entry by entry, like transcode does, keep their
+     *          order, as does the tag of an internally tagged variant.
+     */
+    struct CanonicalFormatter : CompactFormatter {
+        static constexpr bool CANONICAL = true;
+    };
+
+    struct PrettyFormatter {
+        const char *indent = "  ";
+        size_t level = 0;
+
+        PrettyFormatter() = default;
+        PrettyFormatter(const char *indent) : indent(indent) {}
+
+        template<typename W> void newline(W &out) {
+            out += '\n';
+            for (size_t i = 0; i < level; i++) out += indent;
+        }
+
+        template<typename W> void begin_array(W &out) { level++; out += '['; }
+        template<typename W> void end_array(W &out, bool empty) {
+            level--;
+            if (!empty) newline(out);
+            out += ']';
+        }
+        template<typename W> void begin_array_value(W &out, bool first) {
+            if (!first) out += ',';
+            newline(out);
+        }
+        template<typename W> void end_array_value(W &out) { (void)out; }
+
+        template<typename W> void begin_object(W &out) { level++; out += '{'; }
+        template<typename W> void end_object(W &out, bool empty) {
+            level--;
+            if (!empty) newline(out);
+            out += '}';
+        }
+        template<typename W> void begin_object_key(W &out, bool first) {
+            if (!first) out += ',';
+            newline(out);
+        }
+        template<typename W> void end_object_key(W &out) { (void)out; }
+        template<typename W> void begin_object_value(W &out) { out += ": "; }
+        template<typename W> void end_object_value(W &out) { (void)out; }
+    };
+
+    /**
+     * @brief   Most bytes Serializer<CompactFormatter> writes for a T
+     * @details Defined for types whose output has a bound: bool, char,
+     *          numbers, fixed size arrays, Options and derived structs of
+     *          those. Strings, vectors and maps have none, so max_size of a
+     *          struct holding one does not compile. Buffer<T> sized by it
+     *          always fits the output of to_span.
+     */
+    template<typename T>
+    struct MaxSize;
+
+    template<typename T>
+    concept Bounded = requires { MaxSize<T>::value; };
+    template<Bounded T>
+    constexpr size_t max_size = MaxSize<T>::value;
+    template<Bounded T>
+    using Buffer = std::array<char, max_size<T>>;
+
+    template<>
+    struct MaxSize<bool> { static constexpr size_t value = 5; };
+    // serialize_char writes the byte between quotes
+    template<>
+    struct MaxSize<char> { static constexpr size_t value = 3; };
+    template<typename T>
+        requires std::is_integral_v<T> && (!std::is_same_v<T, bool>) && (!std::is_same_v<T, char>)
+    struct MaxSize<T> {
+        static constexpr size_t value =
+            std::numeric_limits<T>::digits10 + 1 + std::is_signed_v<T>;
+    };
+    // Shortest round trip form, at worst scientific: sign, digits, point, exponent
+    template<typename T>
+        requires std::is_floating_point_v<T>
+    struct MaxSize<T> {
+        static constexpr size_t value = 1 + std::numeric_limits<T>::max_digits10 + 1
+            + 2 + (std::numeric_limits<T>::max_exponent10 >= 100 ? 3 : 2);
+    };
+    static_assert(MaxSize<double>::value == sizeof("-1.7976931348623157e+308") - 1);
+    static_assert(MaxSize<float>::value == sizeof("-3.40282347e+38") - 1);
+    template<Bounded T, size_t N>
+    struct MaxSize<std::array<T, N>> {
+        static constexpr size_t value = 2 + N * max_size<T> + (N > 0 ? N - 1 : 0);
+    };
+    template<Bounded T, size_t N>
+    struct MaxSize<T[N]> : MaxSize<std::array<T, N>> {};
+    template<Bounded T>
+    struct MaxSize<ftl::Option<T>> {
+        static constexpr size_t value = std::max<size_t>(4, max_size<T>);
+    };
+
+    template<typename L>
+    struct FieldsMaxSize {};
+    // Every field written: quoted key, colon, value, and the commas between
+    template<typename T, typename... Fs>
+        requires (Bounded<typename Fs::Type> && ...)
+    struct FieldsMaxSize<serde::Fields<T, Fs...>> {
+        static constexpr size_t value =
+            2 + ((Fs::key.quoted.size() + 1 + max_size<typename Fs::Type>) + ...)
+              + sizeof...(Fs) - 1;
+    };
+    template<typename T>
+        requires requires { typename serde::ser::Serialize<T>::Fields; }
+    struct MaxSize<T> : FieldsMaxSize<typename serde::ser::Serialize<T>::Fields> {};
+
+    /**
+     * @brief   Output over a fixed buffer the caller owns, for Serializer<F, SpanWriter>
+     * @details Never allocates. A write that does not fit sets the sticky
+     *          full flag and drops the bytes; the Serializer checks it after
+     *          every element and fails with BufferFull, so the cost of a
+     *          value that does not fit is bounded by the buffer as well.
+     */
+    struct SpanWriter {
+        std::span<char> buf;
+        size_t len = 0;
+        bool full = false;
+
+        SpanWriter() = default;
+        SpanWriter(std::span<char> buf) : buf(buf) {}
+
+        void append(const char *data, size_t n) {
+            if (n > buf.size() - len) {
+                full = true;
+                return;
+            }
+            memcpy(buf.data() + len, data, n);
+            len += n;
+        }
+        void operator+=(char ch) { append(&ch, 1); }
+        void operator+=(const char *str) { append(str, strlen(str)); }
+        void operator+=(std::string_view str) { append(str.data(), str.size()); }
+        void operator+=(const ftl::str &str) {
+            if (str.len() != 0) append(&*str.begin(), str.len());
+        }
+
+        size_t size() const { return len; }
+        size_t capacity() const { return buf.size(); }
+        std::string_view view() const { return std::string_view(buf.data(), len); }
+    };
+
+    /**
+     * @brief   Serializer writing JSON into W
+     * @details W is std::string, which grows as needed, or SpanWriter. The
+     *          Formatter writes to it directly, so W only needs +=, and
+     *          append(data, len).
+     */
+    template<typename F, typename W>
     struct Serializer {
-        std::string output;
+        W output;
+        [[no_unique_address]] F formatter;
+        // Whether the innermost open struct or seq has no elements yet.
+        // Closing a nested one leaves it false, which is right for the
+        // parent too since it just got an element.
+        bool first = true;
+        SERDE_JSON_INSTRUMENT_MEMBER(instrument::TimerStack type_timers)
+        SERDE_JSON_INSTRUMENT_MEMBER(instrument::CapacityTracker capacity)
+
+        static constexpr bool CANONICAL = requires { requires F::CANONICAL; };
+        static constexpr bool SORT_KEYS = CANONICAL;
+
+        Serializer() = default;
+        Serializer(F formatter) : formatter(formatter) {}
+        Serializer(F formatter, W output) : output(std::move(output)), formatter(formatter) {}
 
         using Ok = void;
         using Error = error::Error;
 
         using SerializeStruct = Serializer;
         using SerializeSeq = Serializer;
+        using SerializeMap = Serializer;
 
         Result<Ok> serialize_unit() {
             output += "null";
@@ -46,17 +254,48 @@ namespace serde_json::ser {
             return ftl::Ok();
         }
 
+        Result<Ok> serialize_schar(const signed char &value) { return serialize_long_long(value); }
         Result<Ok> serialize_short(const short &value) { return serialize_long_long(value); }
         Result<Ok> serialize_int(const int &value) { return serialize_long_long(value); }
         Result<Ok> serialize_long(const long &value) { return serialize_long_long(value); }
         Result<Ok> serialize_long_long(const long long &value) {
-            output += std::to_string(value);
+            // std::to_string would allocate for anything longer than the SSO buffer
+            char buf[20];
+            output.append(buf, std::to_chars(buf, buf + sizeof(buf), value).ptr - buf);
             return ftl::Ok();
         }
 
-        Result<Ok> serialize_float(const float &value) { return serialize_double(value); }
+        Result<Ok> serialize_uchar(const unsigned char &value) { return serialize_ulong_long(value); }
+        Result<Ok> serialize_ushort(const unsigned short &value) { return serialize_ulong_long(value); }
+        Result<Ok> serialize_uint(const unsigned int &value) { return serialize_ulong_long(value); }
+        Result<Ok> serialize_ulong(const unsigned long &value) { return serialize_ulong_long(value); }
+        Result<Ok> serialize_ulong_long(const unsigned long long &value) {
+            char buf[20];
+            output.append(buf, std::to_chars(buf, buf + sizeof(buf), value).ptr - buf);
+            return ftl::Ok();
+        }
+
+        Result<Ok> serialize_float(const float &value) {
+            if constexpr (CANONICAL) return serialize_shortest(value);
+            return write_shortest(value);
+        }
         Result<Ok> serialize_double(const double &value) {
-            output += std::to_string(value);
+            if constexpr (CANONICAL) return serialize_shortest(value);
+            return write_shortest(value);
+        }
+
+        // Canonical form: finite only, and no negative zero
+        template<typename T>
+        Result<Ok> serialize_shortest(T value) {
+            if (!std::isfinite(value)) return ftl::Err(Error::custom("NaN and infinities are not JSON"));
+            if (value == 0) value = 0;
+            return write_shortest(value);
+        }
+        // Fewest digits that read back as the same value, at most MaxSize<T> bytes
+        template<typename T>
+        Result<Ok> write_shortest(T value) {
+            char buf[MaxSize<T>::value];
+            output.append(buf, std::to_chars(buf, buf + sizeof(buf), value).ptr - buf);
             return ftl::Ok();
         }
 
@@ -71,43 +310,124 @@ namespace serde_json::ser {
         serialize_struct(const ftl::str &name, const size_t len) {
             (void)name;
             (void)len;
-            output += "{";
+            SERDE_JSON_COUNT(structs[instrument::Ser]);
+            SERDE_JSON_INSTRUMENT_DO(type_timers.push(instrument::view(name)));
+            formatter.begin_object(output);
+            first = true;
             return ftl::Ok(std::ref(*this));
         }
         template<serde::ser::concepts::Serialize T>
         Result<void>
         serialize_field(const ftl::str &key, const T &value) {
-            if (output.back() != '{') {
-                output += ',';
-            }
+            formatter.begin_object_key(output, first);
+            first = false;
             TRY(serde::ser::Serialize<ftl::str>::serialize(key, *this));
-            output += ":";
-            return serde::ser::Serialize<T>::serialize(value, *this);
+            return serialize_field_value(value);
+        }
+        // Derived structs come with their keys already quoted
+        template<serde::ser::concepts::Serialize T>
+        Result<void>
+        serialize_field(const serde::FieldKey &key, const T &value) {
+            formatter.begin_object_key(output, first);
+            first = false;
+            output += key.quoted;
+            return serialize_field_value(value);
         }
-        Result<SerializeStruct::Ok> end() {
-            output += "}";
+        template<serde::ser::concepts::Serialize T>
+        Result<void> serialize_field_value(const T &value) {
+            formatter.end_object_key(output);
+            formatter.begin_object_value(output);
+            TRY(serde::ser::Serialize<T>::serialize(value, *this));
+            formatter.end_object_value(output);
+            SERDE_JSON_INSTRUMENT_DO(capacity.check(output));
+            return check_full();
+        }
+        Result<typename SerializeStruct::Ok> end() {
+            formatter.end_object(output, first);
+            first = false;
+            SERDE_JSON_INSTRUMENT_DO(type_timers.pop());
+            SERDE_JSON_INSTRUMENT_DO(capacity.check(output));
             return ftl::Ok();
         }
 
         Result<SerializeSeq &>
         serialize_seq(ftl::Option<size_t> len) {
             (void)len;
-            output += '[';
+            SERDE_JSON_COUNT(seqs[instrument::Ser]);
+            formatter.begin_array(output);
+            first = true;
             return ftl::Ok(std::ref(*this));
         }
         template<serde::ser::concepts::Serialize T>
         Result<void> serialize_element(const T &value) {
-            if (output.back() != '[') output += ',';
-            return serde::ser::Serialize<T>::serialize(value, *this);
+            formatter.begin_array_value(output, first);
+            first = false;
+            TRY(serde::ser::Serialize<T>::serialize(value, *this));
+            formatter.end_array_value(output);
+            SERDE_JSON_INSTRUMENT_DO(capacity.check(output));
+            return check_full();
         }
-        Result<SerializeSeq::Ok> end_seq() {
-            this->output += "]";
+        Result<typename SerializeSeq::Ok> end_seq() {
+            formatter.end_array(output, first);
+            first = false;
+            SERDE_JSON_INSTRUMENT_DO(capacity.check(output));
+            return ftl::Ok();
+        }
+
+        Result<SerializeMap &>
+        serialize_map(ftl::Option<size_t> len) {
+            (void)len;
+            formatter.begin_object(output);
+            first = true;
+            return ftl::Ok(std::ref(*this));
+        }
+        // JSON keys are strings, so number and bool keys get quoted
+        template<serde::ser::concepts::Serialize T>
+        Result<void> serialize_key(const T &key) {
+            formatter.begin_object_key(output, first);
+            first = false;
+            if constexpr (std::is_arithmetic_v<T> && !std::is_same_v<T, char>) {
+                output += '"';
+                TRY(serde::ser::Serialize<T>::serialize(key, *this));
+                output += '"';
+            } else {
+                TRY(serde::ser::Serialize<T>::serialize(key, *this));
+            }
+            formatter.end_object_key(output);
+            return ftl::Ok();
+        }
+        template<serde::ser::concepts::Serialize T>
+        Result<void> serialize_value(const T &value) {
+            formatter.begin_object_value(output);
+            TRY(serde::ser::Serialize<T>::serialize(value, *this));
+            formatter.end_object_value(output);
+            SERDE_JSON_INSTRUMENT_DO(capacity.check(output));
+            return check_full();
+        }
+        Result<typename SerializeMap::Ok> end_map() {
+            formatter.end_object(output, first);
+            first = false;
+            SERDE_JSON_INSTRUMENT_DO(capacity.check(output));
+            return ftl::Ok();
+        }
+
+        // Stops a fixed size output at the first element that overflowed it
+        Result<void> check_full() const {
+            if constexpr (std::is_same_v<W, SpanWriter>) {
+                if (output.full) return ftl::Err(Error::BufferFull());
+            }
             return ftl::Ok();
         }
     };
-    static_assert(serde::ser::Serializer<Serializer>);
-    static_assert(serde::ser::SerializeStruct<Serializer>);
-    static_assert(serde::ser::SerializeSeq<Serializer>);
+#ifdef SERDE_CHECK_CONCEPTS
+    static_assert(serde::ser::Serializer<Serializer<>>);
+    static_assert(serde::ser::SerializeStruct<Serializer<>>);
+    static_assert(serde::ser::SerializeSeq<Serializer<>>);
+    static_assert(serde::ser::SerializeMap<Serializer<>>);
+    static_assert(serde::ser::Serializer<Serializer<PrettyFormatter>>);
+    static_assert(serde::ser::Serializer<Serializer<CompactFormatter, SpanWriter>>);
+    static_assert(serde::ser::Serializer<Serializer<CanonicalFormatter, Xxh64>>);
+#endif
 }
 
 #endif
@@ -0,0 +1,292 @@
+#ifndef JSON_UTF8_H_
+#define JSON_UTF8_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+/**
+ * UTF-8 validation of JSON strings. valid() takes the SSSE3 path when
+ * the target has it (-march=native on anything x86 from the last 15 years)
+ * and the scalar one otherwise; both accept exactly the well-formed
+ * sequences of RFC 3629: no overlongs, no surrogates, nothing past
+ * U+10FFFF.
+ */
+namespace serde_json::utf8 {
+    enum class Mode : uint8_t {
+        // Invalid UTF-8 is an error
+        Strict,
+        // Ill-formed subsequences become U+FFFD, the string is copied
+        Replace,
+        // Bytes are passed on as they are
+        Off,
+    };
+
+    /**
+     * @brief   Length of the well-formed sequence at p, 0 if there is none
+     * @details *bad is then the length of the maximal subpart to replace
+     *          with one U+FFFD (Unicode 3.9, "substitution of maximal
+     *          subparts"), at least 1.
+     */
+    inline size_t sequence(const unsigned char *p, const unsigned char *end, size_t *bad) {
+        unsigned char c = p[0];
+        size_t len;
+        // Valid range of the second byte, the following ones are 80..BF
+        unsigned char lo = 0x80, hi = 0xBF;
+        if (c < 0x80) return 1;
+        else if (c < 0xC2) len = 0;
+        else if (c < 0xE0) len = 2;
+        else if (c < 0xF0) {
+            len = 3;
+            if (c == 0xE0) lo = 0xA0;
+            if (c == 0xED) hi = 0x9F;
+        } else if (c < 0xF5) {
+            len = 4;
+            if (c == 0xF0) lo = 0x90;
+            if (c == 0xF4) hi = 0x8F;
+        } else len = 0;
+        if (len == 0) {
+            *bad = 1;
+            return 0;
+        }
+        for (size_t i = 1; i < len; i++) {
+            bool ok = p + i < end
+                   && (i == 1 ? p[1] >= lo && p[1] <= hi : (p[i] & 0xC0) == 0x80);
+            if (!ok) {
+                *bad = i;
+                return 0;
+            }
+        }
+        return len;
+    }
+
+    // Offset of the first byte that is not part of a well-formed sequence, n if none
+    inline size_t first_invalid_scalar(const char *data, size_t n) {
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+        const unsigned char *end = p + n;
+        size_t i = 0;
+        while (i < n) {
+            // Eight ASCII bytes at a time
+            if (i + 8 <= n) {
+                uint64_t word;
+                memcpy(&word, p + i, 8);
+                if ((word & 0x8080808080808080) == 0) {
+                    i += 8;
+                    continue;
+                }
+            }
+            size_t bad;
+            size_t len = sequence(p + i, end, &bad);
+            if (len == 0) return i;
+            i += len;
+        }
+        return n;
+    }
+
+#ifdef __SSSE3__
+    namespace detail {
+        // Keiser & Lemire, "Validating UTF-8 In Less Than One Instruction
+        // Per Byte" (2021). Each error class gets one bit; three table
+        // lookups on the nibbles of a byte and of the byte before it
+        // classify every pair, and a pair is wrong when the bits of all
+        // three agree. Sequences of three and four bytes are checked by
+        // comparing where continuations are expected with where they are.
+        constexpr uint8_t TOO_SHORT = 1 << 0;
+        constexpr uint8_t TOO_LONG = 1 << 1;
+        constexpr uint8_t OVERLONG_3 = 1 << 2;
+        constexpr uint8_t TOO_LARGE = 1 << 3;
+        constexpr uint8_t SURROGATE = 1 << 4;
+        constexpr uint8_t OVERLONG_2 = 1 << 5;
+        constexpr uint8_t TOO_LARGE_1000 = 1 << 6;
+        constexpr uint8_t OVERLONG_4 = 1 << 6;
+        constexpr uint8_t TWO_CONTS = 1 << 7;
+        constexpr uint8_t CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+        inline __m128i table(uint8_t b0, uint8_t b1, uint8_t b2, uint8_t b3,
+                             uint8_t b4, uint8_t b5, uint8_t b6, uint8_t b7,
+                             uint8_t b8, uint8_t b9, uint8_t b10, uint8_t b11,
+                             uint8_t b12, uint8_t b13, uint8_t b14, uint8_t b15) {
+            return _mm_setr_epi8(b0, b1, b2, b3, b4, b5, b6, b7,
+                                 b8, b9, b10, b11, b12, b13, b14, b15);
+        }
+        inline __m128i high_nibbles(__m128i v) {
+            return _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0F));
+        }
+
+        inline __m128i special_cases(__m128i input, __m128i prev1) {
+            const __m128i byte_1_high = table(
+                // 0___ ASCII
+                TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+                TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+                // 10__ continuation
+                TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+                // 1100, 1101 two byte lead
+                TOO_SHORT | OVERLONG_2,
+                TOO_SHORT,
+                // 1110 three byte lead
+                TOO_SHORT | OVERLONG_3 | SURROGATE,
+                // 1111 four byte lead
+                TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+            const __m128i byte_1_low = table(
+                CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+                CARRY | OVERLONG_2,
+                CARRY,
+                CARRY,
+                CARRY | TOO_LARGE,
+                CARRY | TOO_LARGE | TOO_LARGE_1000,
+                CARRY | TOO_LARGE | TOO_LARGE_1000,
+                CARRY | TOO_LARGE | TOO_LARGE_1000,
+                CARRY | TOO_LARGE | TOO_LARGE_1000,
+                CARRY | TOO_LARGE | TOO_LARGE_1000,
+                CARRY | TOO_LARGE | TOO_LARGE_1000,
+                CARRY | TOO_LARGE | TOO_LARGE_1000,
+                CARRY | TOO_LARGE | TOO_LARGE_1000,
+                CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+                CARRY | TOO_LARGE | TOO_LARGE_1000,
+                CARRY | TOO_LARGE | TOO_LARGE_1000);
+            const __m128i byte_2_high = table(
+                // 0___ ASCII after a lead
+                TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+                TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+                // 1000
+                TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+                // 1001
+                TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+                // 101_
+                TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+                TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+                // 11__ lead after a lead
+                TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT);
+            __m128i a = _mm_shuffle_epi8(byte_1_high, high_nibbles(prev1));
+            __m128i b = _mm_shuffle_epi8(byte_1_low, _mm_and_si128(prev1, _mm_set1_epi8(0x0F)));
+            __m128i c = _mm_shuffle_epi8(byte_2_high, high_nibbles(input));
+            return _mm_and_si128(_mm_and_si128(a, b), c);
+        }
+
+        // Error bits of input, prev is the 16 bytes before it
+        inline __m128i check_block(__m128i input, __m128i prev) {
+            __m128i prev1 = _mm_alignr_epi8(input, prev, 15);
+            __m128i sc = special_cases(input, prev1);
+            __m128i prev2 = _mm_alignr_epi8(input, prev, 14);
+            __m128i prev3 = _mm_alignr_epi8(input, prev, 13);
+            // High bit set where a third or fourth byte has to follow
+            __m128i third = _mm_subs_epu8(prev2, _mm_set1_epi8((char)(0xE0 - 0x80)));
+            __m128i fourth = _mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xF0 - 0x80)));
+            __m128i must23 = _mm_and_si128(_mm_or_si128(third, fourth), _mm_set1_epi8((char)0x80));
+            return _mm_xor_si128(must23, sc);
+        }
+
+        // Non-zero where the block ends inside a sequence
+        inline __m128i incomplete(__m128i input) {
+            const __m128i max = _mm_setr_epi8(
+                -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+            return _mm_subs_epu8(input, max);
+        }
+    }
+
+    /**
+     * @brief   SSSE3 validation, 16 bytes per step
+     * @details ASCII blocks only test their sign bits. The tail is copied to
+     *          a zeroed block, so nothing past data + n is read.
+     */
+    inline bool valid_ssse3(const char *data, size_t n) {
+        __m128i error = _mm_setzero_si128();
+        __m128i prev = _mm_setzero_si128();
+        __m128i prev_incomplete = _mm_setzero_si128();
+        size_t i = 0;
+        for (;; i += 16) {
+            __m128i input;
+            if (i + 16 <= n) {
+                input = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+            } else {
+                alignas(16) char tail[16] = {};
+                memcpy(tail, data + i, n - i);
+                input = _mm_load_si128(reinterpret_cast<const __m128i *>(tail));
+            }
+            if (_mm_movemask_epi8(input) == 0) {
+                error = _mm_or_si128(error, prev_incomplete);
+            } else {
+                error = _mm_or_si128(error, detail::check_block(input, prev));
+                prev_incomplete = detail::incomplete(input);
+            }
+            prev = input;
+            if (i + 16 >= n) break;
+        }
+        error = _mm_or_si128(error, prev_incomplete);
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) == 0xFFFF;
+    }
+#endif
+
+    // Whether [data, data + n) is well-formed UTF-8
+    inline bool valid(const char *data, size_t n) {
+#ifdef __SSSE3__
+        // Below a block the setup costs more than the scalar loop
+        if (n >= 16) return valid_ssse3(data, n);
+#endif
+        return first_invalid_scalar(data, n) == n;
+    }
+
+    /**
+     * @brief   First '"' in [p, end), nullptr if there is none
+     * @details What memchr does, but *ascii is also cleared when a byte
+     *          before the quote has its high bit set. With SSE2 both come
+     *          out of the same 16 byte loads, so strings that are plain
+     *          ASCII, nearly all of them, are checked for free and only
+     *          the others go through valid().
+     */
+    inline const char *find_quote(const char *p, const char *end, bool *ascii) {
+        unsigned high = 0;
+#ifdef __SSE2__
+        const __m128i quote = _mm_set1_epi8('"');
+        for (; end - p >= 16; p += 16) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+            unsigned quotes = _mm_movemask_epi8(_mm_cmpeq_epi8(block, quote));
+            unsigned bits = _mm_movemask_epi8(block);
+            if (quotes != 0) {
+                unsigned before = (quotes & -quotes) - 1;
+                *ascii = (high | (bits & before)) == 0;
+                return p + __builtin_ctz(quotes);
+            }
+            high |= bits;
+        }
+#endif
+        for (; p != end; p++) {
+            if (*p == '"') {
+                *ascii = high == 0;
+                return p;
+            }
+            high |= (unsigned char)*p & 0x80;
+        }
+        return nullptr;
+    }
+
+    // Appends [data, data + n) to out with every ill-formed subpart replaced
+    inline void append_replaced(const char *data, size_t n, std::string &out) {
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+        const unsigned char *end = p + n;
+        out.reserve(out.size() + n + 2);
+        size_t i = 0;
+        while (i < n) {
+            size_t bad;
+            size_t len = sequence(p + i, end, &bad);
+            if (len == 0) {
+                out += "\xEF\xBF\xBD";
+                i += bad;
+            } else {
+                out.append(data + i, len);
+                i += len;
+            }
+        }
+    }
+}
+
+#endif // !JSON_UTF8_H_
@@ -1,28 +1,44 @@
 #include <array>
+#include <deque>
+#include <cstdint>
 #include <cstdio>
 #include <iostream>
+#include <limits>
+#include <map>
 #include <ostream>
+#include <string_view>
+#include <variant>
 #include <string>
+#include <unordered_map>
 #include <assert.h>
 
 #include <ftl.hpp>
 #include <vector>
 
+#include "serde/flat_map.hpp"
+#include "serde/intern.hpp"
 #include "serde/macros.hpp"
+#include "serde/transcode.hpp"
+#include "serde_json/engine.hpp"
 #include "serde_json/error.hpp"
+#include "serde_json/file.hpp"
+#include "serde_json/framer.hpp"
 #include "serde_json/json.hpp"
 
-#define _DEBUG_FIELD(x) << ", " << #x << ": " << self.x
+#define _STRINGIFY(x) #x
+#define STRINGIFY(x) _STRINGIFY(x)
+#define _DEBUG_FIELD_NAMED(x) << ", " << #x << ": " << debug << self.x
+#define _DEBUG_FIELD_NAMED_(x) _DEBUG_FIELD_NAMED(x)
+#define _DEBUG_FIELD(x) _DEBUG_FIELD_NAMED_(FIELD_NAME(x))
 #define DEBUG_STRUCT(T, FIRST, ...)                                              \
     inline std::ostream &operator<<(ftl::Debug &&debug, const T &self) {         \
-        return debug.out << #T << " { " << #FIRST << ": " << debug << self.FIRST \
+        return debug.out << #T << " { " << STRINGIFY(FIELD_NAME(FIRST)) << ": "  \
+        << debug << self.FIELD_NAME(FIRST)                                       \
         FOREACH(_DEBUG_FIELD, __VA_ARGS__) << " }";                              \
     }
 
 #define DEBUG(SIG) DEBUG_STRUCT SIG
 
-#define DERIVE(SIG, ...) APPLYEACH(SIG, __VA_ARGS__)
-
 struct RGB {
     int r;
     int g;
@@ -36,10 +52,58 @@ struct ColoredText {
 };
 DERIVE((ColoredText, color, text), DEBUG, SERIALIZE, DESERIALIZE)
 
+struct Ping {
+    int seq;
+    int ttl;
+};
+DERIVE((Ping, seq, ttl), DEBUG, SERIALIZE, DESERIALIZE)
+
+// Sparse record, absent options are left out both ways
+struct Profile {
+    int id;
+    ftl::Option<ftl::str> nickname;
+    ftl::Option<int> age;
+    int score = 10;
+};
+DERIVE((Profile, id, (nickname, skip_if_none, default), (age, skip_if_none), (score, default)),
+       DEBUG, SERIALIZE, DESERIALIZE)
+
+// Const members: no default constructor and not assignable, built in place
+struct Reading {
+    const int sensor;
+    const RGB color;
+};
+DERIVE((Reading, sensor, color), DEBUG, SERIALIZE, DESERIALIZE)
+
+// One variant per tag style
+using Message = std::variant<RGB, ColoredText>;
+using Event = std::variant<RGB, Ping>;
+using Envelope = std::variant<ColoredText, Ping>;
+
+template<>
+struct serde::VariantRepr<Event> {
+    static constexpr TagStyle style = TagStyle::Internal;
+    static constexpr ftl::str tag = "type";
+    static constexpr ftl::str content = "content";
+};
+template<>
+struct serde::VariantRepr<Envelope> {
+    static constexpr TagStyle style = TagStyle::Adjacent;
+    static constexpr ftl::str tag = "t";
+    static constexpr ftl::str content = "c";
+};
+
 /* static_assert(serde::de::Visitor< */
 /*         serde::de::Deserialize<RGB>::Visitor, */
 /*         serde_json::error::Error>); */
 
+// Compact output with a space after `:` and `,`
+struct SpacedFormatter : serde_json::ser::CompactFormatter {
+    template<typename W> void begin_array_value(W &out, bool first) { if (!first) out += ", "; }
+    template<typename W> void begin_object_key(W &out, bool first) { if (!first) out += ", "; }
+    template<typename W> void begin_object_value(W &out) { out += ": "; }
+};
+
 using namespace std;
 using namespace ftl;
 
@@ -61,9 +125,232 @@ int main() {
          << debug << serde_json::to_string(Some(69)) << endl
          << debug << serde_json::to_string(None()) << endl;
 
+    cout << serde_json::to_string_pretty(foo).unwrap() << endl
+         << serde_json::to_string_pretty(Slice<const RGB>{{1, 2, 3}}).unwrap() << endl
+         << serde_json::to_string_pretty(vector<int>{}).unwrap() << endl
+         << serde_json::to_string_with(vector{foo, foo}, SpacedFormatter{}).unwrap() << endl;
+
+    cout << debug << serde_json::to_string(map<string, int>{{"a", 1}, {"b", 2}}) << endl
+         << debug << serde_json::to_string(map<int, RGB>{{7, color}}) << endl
+         << serde_json::to_string_pretty(map<string, int>{}).unwrap() << endl;
+
+    auto by_id = serde_json::from_str<map<int, int>>(R"({"1":2,"3":4,"1":5})").unwrap();
+    cout << debug << serde_json::to_string(by_id) << endl;
+    auto flat = serde_json::from_str<serde::FlatMap<string, int>>(R"({"b":2,"a":1})").unwrap();
+    cout << debug << serde_json::to_string(flat) << endl
+         << flat.find(string_view("b"))->second << endl;
+    auto cache = serde_json::from_str<unordered_map<string, RGB, serde::de::StringHash, equal_to<>>>(
+            R"({"x":{"r":1,"g":2,"b":3},"y":{"r":4,"g":5,"b":6},"x":{"r":7,"g":8,"b":9}})").unwrap();
+    cout << cache.size() << " " << cache.bucket_count() << " " << cache.find(string_view("x"))->second.r << endl
+         << serde_json::from_str<map<string, int, less<>>>(R"({"b":1,"a":2,"b":3})").unwrap().at("b") << endl;
+
+    cout << debug << serde_json::to_string(Message(foo)) << endl
+         << debug << serde_json::to_string(Event(Ping{7, 64})) << endl
+         << debug << serde_json::to_string(Envelope(Ping{8, 64})) << endl;
+
+    auto message = serde_json::from_str<Message>(R"({"RGB":{"r":1,"g":2,"b":3}})").unwrap();
+    cout << debug << get<RGB>(message) << endl;
+    auto event = serde_json::from_str<Event>(R"({"type":"RGB","r":4,"g":5,"b":6})").unwrap();
+    cout << debug << get<RGB>(event) << endl;
+    event = serde_json::from_str<Event>(R"({"seq":9,"type":"Ping","ttl":3})").unwrap();
+    cout << debug << get<Ping>(event) << endl;
+    auto envelope = serde_json::from_str<Envelope>(R"({"t":"Ping","c":{"seq":10,"ttl":2}})").unwrap();
+    cout << debug << get<Ping>(envelope) << endl;
+    auto index = [](const auto &v) { return v.index(); };
+    cout << debug << serde_json::from_str<Message>(R"({"HSV":{}})").map(index) << endl
+         << debug << serde_json::from_str<Message>("[]").map(index) << endl
+         << debug << serde_json::from_str<Event>(R"({"seq":9})").map(index) << endl;
+
     cout << debug << serde_json::from_str<RGB>(R"({"r":0,"g":255,"b":123})") << endl;
     cout << debug << serde_json::from_str<ColoredText>(R"({"color":{"r":5,"g":25,"b":30},"text":"baz"})") << endl;
-    cout << debug << serde_json::from_str<array<int, 2>>("[69,420]") << endl;
+    cout << debug << serde_json::from_str<array<int, 2>>("[69,420]") << endl
+         << debug << serde_json::from_str<array<int, 2>>("[]") << endl
+         << debug << serde_json::from_str<array<int, 2>>("[69]") << endl
+         << debug << serde_json::from_str<array<int, 2>>("[69,420,1]") << endl
+         << debug << serde_json::validate<array<int, 2>>("[69]") << endl
+         << debug << serde_json::validate<array<int, 2>>("[69,420,1]") << endl;
+    cout << debug << serde_json::from_str<RGB>(R"({"r":0,"green":255,"b":123})") << endl;
+    {
+        // Attached to its input the whole name is shown, detached its length
+        const char *json = R"({"r":0,"green_channel_value":255,"b":123})";
+        serde_json::de::Deserializer in(json);
+        cout << debug << serde::de::Deserialize<RGB>::deserialize(in) << endl
+             << debug << serde_json::from_str<RGB>(json) << endl;
+    }
+    cout << debug << serde_json::from_str<RGB>(R"({"r":0,"b":123})") << endl;
+    cout << debug << serde_json::from_str<ColoredText>("{\"color\":\n{\"r\":5,\"g\"25}}") << endl;
+    // The input is gone before the error is printed
+    auto late = serde_json::validate<ColoredText>(
+            string("{\"text\":\"a\nb\nc\",\"color\":{\"r\":1,\"g\":2,\"b\":x}}").c_str());
+    cout << debug << late << endl;
+    {
+        // A string of the input in an Unexpected is dropped on detach, not copied
+        string color = "teal";
+        auto err = serde_json::error::Error::invalid_value(
+                serde::de::Unexpected::Str(ftl::str(color.data(), color.size())))
+            .at(color.data(), color.data() + color.size());
+        cout << err.description() << endl;
+        err = err.detach();
+        color.assign(64, 'x');
+        cout << err.description() << endl;
+    }
+
+    cout << debug << serde_json::validate<vector<ColoredText>>(R"([{"color":{"r":5,"g":25,"b":30},"text":"baz"}])") << endl
+         << debug << serde_json::validate<ColoredText>(R"({"color":{"r":5,"g":25},"text":"baz"})") << endl
+         << debug << serde_json::validate<RGB>(R"({"r":0,"g":1,"r":2,"b":3})") << endl
+         << debug << serde_json::validate<map<int, RGB>>(R"({"1":{"r":0,"g":1,"b":"2"}})") << endl;
+
+    {
+        serde_json::de::Deserializer in(R"({"id":7,"tags":["a","b"],"geo":null,"score":-1.5,"ok":true})");
+        serde_json::ser::Serializer<serde_json::ser::PrettyFormatter> out;
+        cout << debug << serde::transcode(in, out) << endl << out.output << endl;
+        serde_json::de::Deserializer bad(R"({"id":[1,}")");
+        serde_json::ser::Serializer<> partial;
+        cout << debug << serde::transcode(bad, partial) << endl;
+    }
+
+    const char unterminated[] = {'[', '6', ',', '9', ']', '7'};
+    cout << debug << serde_json::from_slice<array<int, 2>>(unterminated, 5) << endl
+         << debug << serde_json::from_slice<int>(unterminated + 1, 1) << endl
+         << debug << serde_json::from_slice<array<int, 2>>(unterminated, 4) << endl
+         << debug << serde_json::from_file<RGB>("/nonexistent/rgb.json").map([](auto &&) { return 0; }) << endl;
+
+    {
+        serde_json::DocumentFramer<ColoredText> body;
+        for (const char *chunk : {R"({"color":{"r":1,"g")", R"(:2,"b":3},"text":"a}b"})", R"({"color":)"}) {
+            cout << debug << body.feed(chunk, strlen(chunk)) << endl;
+        }
+        cout << debug << body.take() << endl
+             << body.ready() << endl
+             << debug << body.feed(R"({"r":4,"g":5,"b":6},"text":""})", 30) << endl
+             << debug << body.take() << endl;
+        const char pipelined[] = "\n{\"color\":{\"r\":7,\"g\":8,\"b\":9},\"text\":\"c\"}\r\n\n 12 ";
+        serde_json::DocumentFramer<ColoredText> stream;
+        serde_json::DocumentFramer<int> numbers;
+        cout << debug << stream.feed(pipelined, 48) << endl
+             << debug << stream.take() << endl
+             << stream.ready() << endl
+             << debug << numbers.feed(pipelined + 41, 7) << endl
+             << debug << numbers.take() << endl
+             << numbers.ready() << endl;
+    }
+
+    {
+        string deep = string(100000, '[') + string(100000, ']');
+        serde_json::de::Deserializer in(deep.c_str());
+        serde_json::ser::Serializer<> out;
+        cout << debug << serde::transcode(in, out) << endl
+             << debug << serde_json::from_str<vector<vector<int>>>("[[1],[2,3]]").map([](auto &&v) { return v.size(); }) << endl;
+        serde_json::de::Deserializer shallow("[[[]]]");
+        shallow.remaining_depth = 2;
+        cout << debug << serde::transcode(shallow, out) << endl;
+    }
+
+    {
+        Profile sparse{7, ftl::Some(ftl::str("ann", 3)), ftl::Option<int>(ftl::None()), 3};
+        // What skip_if_none leaves out reads back as None
+        cout << serde_json::to_string(sparse).unwrap() << endl
+             << debug << serde_json::from_str<Profile>(serde_json::to_string(sparse).unwrap().c_str()) << endl
+             << debug << serde_json::from_str<Profile>(R"({"id":1,"age":null})") << endl
+             << debug << serde_json::from_str<Profile>(R"({"id":1,"age":30,"nickname":"bo"})") << endl
+             << debug << serde_json::from_str<Profile>(R"({"id":1})") << endl
+             << debug << serde_json::from_str<Reading>(R"({"color":{"r":1,"g":2,"b":3},"sensor":4})") << endl
+             << debug << serde_json::from_str<Reading>(R"({"sensor":4})") << endl
+             << debug << serde_json::validate<Profile>(R"({"id":1,"age":null})") << endl
+             << debug << serde_json::validate<Profile>(R"({"age":null})") << endl;
+    }
+
+    {
+        vector<int> ids{1};
+        cout << debug << serde_json::from_str_seed(serde::de::Extend<vector<int>>{&ids}, "[2,3]") << endl
+             << debug << serde_json::from_str_seed(serde::de::Extend<vector<int>>{&ids}, "[4,") << endl
+             << ids.size() << " " << ids.back() << endl;
+    }
+
+    {
+        serde::InternPool pool;
+        auto first = serde_json::from_str_seed(serde::de::InternSeed{&pool}, R"("eu-west")").unwrap();
+        auto second = serde_json::from_str_seed(serde::de::InternSeed{&pool}, R"("eu-west")").unwrap();
+        cout << first.view() << " " << (first == second) << " " << pool.size() << endl
+             << serde_json::from_str<serde::Interned>(R"("")").unwrap().size << endl
+             << serde_json::to_string(second).unwrap() << endl;
+    }
+
+    {
+        const serde_json::Engine<> shallow({.depth_limit = 2});
+        cout << shallow.write(RGB{1, 2, 3}).unwrap() << endl
+             << debug << shallow.from_str<array<int, 2>>("[8,9]") << endl
+             << debug << shallow.from_str<vector<vector<vector<int>>>>("[[[1]]]").map([](auto &&v) { return v.size(); }) << endl;
+        const serde_json::Engine<SpacedFormatter> spaced;
+        cout << spaced.to_string(ColoredText{{5, 6, 7}, "qux"}).unwrap() << endl;
+    }
+
+    {
+        deque<string> repaired;
+        const serde_json::Engine<> raw({.utf8_mode = serde_json::utf8::Mode::Off});
+        cout << debug << serde_json::from_str<ftl::str>("\"caf\xc3\xa9 cr\xc3\xa8me br\xc3\xbbl\xc3\xa9" "e\"") << endl
+             << debug << serde_json::from_str<ftl::str>("\"a\xff b\"") << endl
+             << debug << serde_json::from_str<ftl::str>("\"overlong slash in a long string \xc0\xaf\"") << endl
+             << debug << serde_json::from_str<ftl::str>("\"surrogate \xed\xa0\x80\"") << endl
+             << debug << serde_json::from_str_lossy<ftl::str>("\"a\xff b\xe2\x82\"", repaired) << endl
+             << debug << raw.from_str<ftl::str>("\"a\xff\"").map([](ftl::str s) { return s.len(); }) << endl;
+    }
+
+    {
+        auto widen = [](auto v) { return (int)v; };
+        cout << debug << serde_json::from_str<uint8_t>("255").map(widen) << endl
+             << debug << serde_json::from_str<uint8_t>("256").map(widen) << endl
+             << debug << serde_json::from_str<int8_t>("-128").map(widen) << endl
+             << debug << serde_json::from_str<int16_t>("-32769") << endl
+             << debug << serde_json::from_str<uint32_t>("-1") << endl
+             << debug << serde_json::from_str<uint64_t>("18446744073709551615") << endl
+             << debug << serde_json::from_str<int64_t>("-9223372036854775808") << endl
+             << debug << serde_json::from_str<long long>("9223372036854775807") << endl
+             << debug << serde_json::from_str<long long>("9223372036854775808") << endl
+             << debug << serde_json::from_str<long long>("-9223372036854775809") << endl
+             << debug << serde_json::from_str<long long>("9999999999999999999") << endl
+             << debug << serde_json::from_str<long>("-9999999999999999999") << endl
+             << debug << serde_json::from_str<bool>("true") << endl
+             << debug << serde_json::from_str<char>(R"("x")") << endl
+             << debug << serde_json::from_str<float>("0.1") << endl
+             << serde_json::to_string(array<uint64_t, 2>{0, 18446744073709551615u}).unwrap() << endl;
+    }
+
+    {
+        serde_json::ser::Buffer<RGB> buf;
+        char tiny[8];
+        ftl::Option<double> price = ftl::Some(101.25);
+        cout << serde_json::ser::max_size<RGB> << " " << serde_json::ser::Bounded<ColoredText> << endl
+             << serde_json::to_span(RGB{-1, 20, 300}, buf).unwrap() << endl
+             << debug << serde_json::to_span(RGB{-1, 20, 300}, tiny) << endl
+             << serde_json::to_span(price, buf).unwrap() << endl;
+
+        // The widest doubles fill their bound exactly and read back the same
+        serde_json::ser::Buffer<double> wide;
+        double lowest = -1.7976931348623157e308, denormal = -4.9406564584124654e-324;
+        cout << serde_json::ser::max_size<double> << " "
+             << serde_json::to_span(lowest, wide).unwrap() << " "
+             << serde_json::to_span(denormal, wide).unwrap() << " "
+             << (serde_json::from_str<double>(serde_json::to_string(lowest).unwrap().c_str()).unwrap() == lowest)
+             << endl;
+    }
+
+    {
+        unordered_map<int, double> ratios{{10, 0.1}, {9, -0.0}, {-1, 1e21}, {-2, 2.5f}};
+        map<string, RGB> named{{"b", {1, 2, 3}}, {"a", {4, 5, 6}}};
+        auto hex = [](uint64_t h) { char buf[17]; snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)h); return string(buf); };
+        string canonical = serde_json::to_string_canonical(named).unwrap();
+        cout << serde_json::to_string_canonical(ratios).unwrap() << endl
+             << canonical << endl
+             << serde_json::to_string_canonical(Profile{1, ftl::Some(ftl::str("al", 2)), ftl::Option<int>(ftl::None()), 5}).unwrap() << endl
+             << debug << serde_json::to_string_canonical(std::numeric_limits<double>::infinity()) << endl
+             << hex(serde_json::Xxh64::hash("", 0)) << endl
+             << (serde_json::hash_canonical(named).unwrap() == serde_json::Xxh64::hash(canonical.data(), canonical.size())) << endl;
+    }
+
+#ifdef SERDE_JSON_INSTRUMENT
+    serde_json::instrument::dump(cout);
+#endif
 
     return 0;
 }